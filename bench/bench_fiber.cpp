@@ -0,0 +1,460 @@
+/**
+ * 协程上下文切换与生命周期基准测试
+ * 结果以 JSON Lines 格式输出到标准输出，每行一个测试结果，便于对比不同的上下文切换与协程栈实现。
+ * 用法: bench_fiber [最大线程数]
+ * 内存占用相关的测试各自在新启动的进程中运行（--memory、--stack-touch 参数由程序内部使用）。
+*/
+#include "fiber.h"
+#include "log.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <alloca.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double ElapsedNS(Clock::time_point begin)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+}
+
+// 当前进程的常驻内存（字节）
+static size_t CurrentRSS()
+{
+    size_t pages = 0, resident = 0;
+    FILE* fp = ::fopen("/proc/self/statm", "r");
+    if (fp)
+    {
+        if (::fscanf(fp, "%zu %zu", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        ::fclose(fp);
+    }
+    return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+// 打开当前线程的 DTLB 读缺失计数器，内核或权限不支持时返回 -1
+static int OpenDTLBCounter()
+{
+    perf_event_attr attr;
+    ::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+static double ReadCounter(int fd)
+{
+    uint64_t value = 0;
+    if (fd < 0 || ::read(fd, &value, sizeof(value)) != sizeof(value))
+    {
+        return -1;
+    }
+    return static_cast<double>(value);
+}
+
+static void Report(const char* bench, const std::string& params, uint64_t ops, double total_ns,
+                   const char* extra_key = nullptr, double extra_value = 0)
+{
+    ::printf("{\"bench\":\"%s\",\"context\":\"%s\",%s\"ops\":%lu,\"total_ns\":%.0f,\"ns_per_op\":%.2f",
+             bench, FIBER_USE_ASM_CONTEXT ? "asm" : "ucontext", params.c_str(),
+             static_cast<unsigned long>(ops), total_ns, ops ? total_ns / ops : 0.0);
+    if (extra_key)
+    {
+        ::printf(",\"%s\":%.2f", extra_key, extra_value);
+    }
+    ::printf("}\n");
+    ::fflush(stdout);
+}
+
+// 主协程与子协程之间来回切换，每次 call()/back() 计为两次切换
+static void BenchPingPong(uint64_t rounds)
+{
+    Fiber::GetThis();
+    bool running = true;
+    auto fiber = std::make_shared<Fiber>([&running]() {
+        while (running)
+        {
+            Fiber::Yield();
+        }
+    });
+    auto begin = Clock::now();
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+        fiber->call();
+    }
+    double ns = ElapsedNS(begin);
+    running = false;
+    fiber->call();
+    Report("ping_pong", "", rounds * 2, ns);
+}
+
+// 创建、运行、销毁协程
+static void BenchCreateRunDestroy(uint64_t count, bool pooled)
+{
+    Fiber::GetThis();
+    uint64_t sum = 0;
+    auto begin = Clock::now();
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        auto callback = [&sum, i]() { sum += i; };
+        Fiber::ptr fiber = pooled ? Fiber::Acquire(callback) : std::make_shared<Fiber>(callback);
+        fiber->call();
+        if (pooled)
+        {
+            Fiber::Recycle(std::move(fiber));
+        }
+    }
+    double ns = ElapsedNS(begin);
+    Report("create_run_destroy", pooled ? "\"pooled\":true," : "\"pooled\":false,", count, ns);
+}
+
+// 多个调度线程上的协程反复让出执行权并重新加入调度
+static void BenchYieldStorm(size_t threads, size_t fibers, uint64_t yields)
+{
+    std::atomic<size_t> finished{0};
+    Scheduler scheduler(threads, false, "bench");
+    scheduler.start();
+    auto begin = Clock::now();
+    for (size_t i = 0; i < fibers; ++i)
+    {
+        scheduler.schedule([&finished, yields]() {
+            for (uint64_t n = 0; n < yields; ++n)
+            {
+                Scheduler::GetThis()->schedule(Fiber::GetThis());
+                Fiber::YieldToHold();
+            }
+            ++finished;
+        });
+    }
+    while (finished < fibers)
+    {
+        ::usleep(1000);
+    }
+    double ns = ElapsedNS(begin);
+    scheduler.stop();
+    Report("yield_storm",
+           "\"threads\":" + std::to_string(threads) + ",\"fibers\":" + std::to_string(fibers) + ",",
+           fibers * yields, ns);
+}
+
+// 二叉任务树的一个节点：非叶子节点产生两个子任务
+static void SpawnNode(Scheduler* scheduler, std::atomic<uint64_t>* leaves, int depth)
+{
+    if (depth == 0)
+    {
+        leaves->fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        scheduler->schedule([scheduler, leaves, depth]() { SpawnNode(scheduler, leaves, depth - 1); });
+    }
+}
+
+// 工作线程上递归产生大量小任务，对比全局队列与工作窃取两种调度模式的吞吐量
+static void BenchSpawnTree(size_t threads, int depth, bool work_stealing)
+{
+    SchedulerInfo::g_work_stealing->setValue(work_stealing);
+    std::atomic<uint64_t> leaves{0};
+    const uint64_t expect = 1ull << depth;
+    Scheduler scheduler(threads, false, "bench");
+    scheduler.start();
+    auto begin = Clock::now();
+    scheduler.schedule([&scheduler, &leaves, depth]() { SpawnNode(&scheduler, &leaves, depth); });
+    while (leaves.load(std::memory_order_relaxed) < expect)
+    {
+        ::usleep(100);
+    }
+    double ns = ElapsedNS(begin);
+    scheduler.stop();
+    SchedulerInfo::g_work_stealing->setValue(false);
+    Report("spawn_tree",
+           "\"threads\":" + std::to_string(threads) + ",\"work_stealing\":" +
+               (work_stealing ? "true" : "false") + ",",
+           expect * 2 - 1, ns);
+}
+
+// 大量很短的回调任务的吞吐量：对比在协程中执行与直接在调度协程上执行（scheduleInline）
+static void BenchTinyTasks(size_t threads, uint64_t count, bool run_inline)
+{
+    std::atomic<uint64_t> done{0};
+    Scheduler scheduler(threads, false, "bench");
+    scheduler.start();
+    auto begin = Clock::now();
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        auto task = [&done]() { done.fetch_add(1, std::memory_order_relaxed); };
+        if (run_inline)
+        {
+            scheduler.scheduleInline(task);
+        }
+        else
+        {
+            scheduler.schedule(task);
+        }
+    }
+    while (done.load(std::memory_order_relaxed) < count)
+    {
+        ::usleep(100);
+    }
+    double ns = ElapsedNS(begin);
+    scheduler.stop();
+    Report("tiny_tasks",
+           "\"threads\":" + std::to_string(threads) + ",\"inline\":" +
+               (run_inline ? "true" : "false") + ",",
+           count, ns);
+}
+
+// 进程消耗的 CPU 时间（纳秒）
+static double ProcessCPUNS()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 没有任务时调度器消耗的 CPU：工作线程应当休眠而不是自旋
+static void BenchIdleCPU(size_t threads, uint64_t idle_ms)
+{
+    Scheduler scheduler(threads, false, "bench");
+    scheduler.start();
+    // 等待工作线程进入空闲状态
+    ::usleep(10000);
+    double cpu_begin = ProcessCPUNS();
+    auto begin = Clock::now();
+    ::usleep(idle_ms * 1000);
+    double ns = ElapsedNS(begin);
+    double cpu = ProcessCPUNS() - cpu_begin;
+    scheduler.stop();
+    Report("idle_cpu", "\"threads\":" + std::to_string(threads) + ",", 1, ns, "cpu_percent",
+           cpu * 100 / ns);
+}
+
+// 外部线程向空闲的调度器提交任务，到任务开始执行的延迟
+static void BenchWakeLatency(size_t threads, uint64_t rounds, uint64_t gap_us)
+{
+    Scheduler scheduler(threads, false, "bench");
+    scheduler.start();
+    ::usleep(10000);
+    std::atomic<uint64_t> done{0};
+    double total = 0;
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+        // 间隔足够长，工作线程已经休眠
+        ::usleep(gap_us);
+        auto begin = Clock::now();
+        std::atomic<double> latency{0};
+        scheduler.schedule([&begin, &latency, &done]() {
+            latency = ElapsedNS(begin);
+            ++done;
+        });
+        while (done.load() <= i)
+        {
+            std::this_thread::yield();
+        }
+        total += latency.load();
+    }
+    scheduler.stop();
+    Report("wake_latency",
+           "\"threads\":" + std::to_string(threads) + ",\"gap_us\":" + std::to_string(gap_us) + ",",
+           rounds, total);
+}
+
+// 堆上已分配的字节数（包括 malloc 直接 mmap 的大块）
+static size_t HeapInUse()
+{
+    struct mallinfo2 info = ::mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+// 在新的进程中重新执行本程序，只运行 args 指定的一项测试：新进程的堆与协程栈缓存都是空的，
+// 常驻内存的差值才不受之前测试的影响
+static void RunInFreshProcess(const std::vector<std::string>& args)
+{
+    ::fflush(stdout);
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>("bench_fiber"));
+        for (auto& arg : args)
+        {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        ::execv("/proc/self/exe", argv.data());
+        ::_exit(127);
+    }
+    if (pid > 0)
+    {
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+    }
+}
+
+// 存活协程的平均内存占用：每个协程使用一部分栈后挂起
+// heap_bytes_per_fiber 是 mallinfo2 统计的堆内存（协程对象、共享栈协程保存的栈内容等），
+// stack_bytes_per_fiber 是常驻内存中堆以外的部分，主要是独立栈协程的栈映射
+static void BenchMemoryPerFiber(size_t count, bool shared_stack)
+{
+    Fiber::GetThis();
+    std::vector<Fiber::ptr> fibers;
+    fibers.reserve(count);
+    size_t rss_before = CurrentRSS();
+    size_t heap_before = HeapInUse();
+    auto begin = Clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        fibers.push_back(std::make_shared<Fiber>([]() {
+            volatile char buffer[2048];
+            buffer[0] = 0;
+            buffer[sizeof(buffer) - 1] = buffer[0];
+            Fiber::Yield();
+        }, 0, shared_stack));
+        fibers.back()->call();
+    }
+    double ns = ElapsedNS(begin);
+    const double rss = static_cast<double>(CurrentRSS()) - rss_before;
+    const double heap = static_cast<double>(HeapInUse()) - heap_before;
+    for (auto& fiber : fibers)
+    {
+        fiber->call();
+    }
+    Report("memory_per_fiber",
+           std::string("\"shared_stack\":") + (shared_stack ? "true" : "false") +
+               ",\"rss_bytes_per_fiber\":" + std::to_string(rss / count) +
+               ",\"heap_bytes_per_fiber\":" + std::to_string(heap / count) +
+               ",\"stack_bytes_per_fiber\":" + std::to_string(std::max(rss - heap, 0.0) / count) + ",",
+           count, ns);
+}
+
+// 协程栈的预留与透明大页：每个协程使用 touch_bytes 的栈后挂起，再全部恢复一轮
+// 统计平均常驻内存、耗时与 DTLB 缺失数
+static void BenchStackTouch(size_t count, size_t touch_bytes, bool reserve, bool hugepage)
+{
+    FiberInfo::g_stack_reserve->setValue(reserve);
+    FiberInfo::g_stack_hugepage->setValue(hugepage);
+    Fiber::GetThis();
+    std::vector<Fiber::ptr> fibers;
+    fibers.reserve(count);
+    int dtlb = OpenDTLBCounter();
+    size_t rss_before = CurrentRSS();
+    auto begin = Clock::now();
+    if (dtlb >= 0)
+    {
+        ::ioctl(dtlb, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        fibers.push_back(std::make_shared<Fiber>([touch_bytes]() {
+            volatile char* buffer = static_cast<volatile char*>(::alloca(touch_bytes));
+            for (size_t n = 0; n < touch_bytes; n += 64)
+            {
+                buffer[n] = static_cast<char>(n);
+            }
+            Fiber::Yield();
+            size_t sum = 0;
+            for (size_t n = 0; n < touch_bytes; n += 64)
+            {
+                sum += buffer[n];
+            }
+            buffer[0] = static_cast<char>(sum);
+        }));
+        fibers.back()->call();
+    }
+    size_t rss_after = CurrentRSS();
+    for (auto& fiber : fibers)
+    {
+        fiber->call();
+    }
+    if (dtlb >= 0)
+    {
+        ::ioctl(dtlb, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    double ns = ElapsedNS(begin);
+    double misses = ReadCounter(dtlb);
+    if (dtlb >= 0)
+    {
+        ::close(dtlb);
+    }
+    fibers.clear();
+    FiberInfo::g_stack_reserve->setValue(false);
+    FiberInfo::g_stack_hugepage->setValue(false);
+    Report("stack_touch",
+           "\"touch_bytes\":" + std::to_string(touch_bytes) +
+               ",\"reserve\":" + (reserve ? "true" : "false") +
+               ",\"hugepage\":" + (hugepage ? "true" : "false") +
+               ",\"bytes_per_fiber\":" +
+               std::to_string(static_cast<double>(rss_after - rss_before) / count) +
+               ",\"dtlb_misses\":" + std::to_string(misses) + ",",
+           count, ns);
+}
+
+int main(int argc, char** argv)
+{
+    Log::set_log_level(LFATAL);
+    // 由 RunInFreshProcess 启动的单项内存测试
+    if (argc > 2 && ::strcmp(argv[1], "--memory") == 0)
+    {
+        BenchMemoryPerFiber(10000, ::atoi(argv[2]) != 0);
+        return 0;
+    }
+    if (argc > 3 && ::strcmp(argv[1], "--stack-touch") == 0)
+    {
+        BenchStackTouch(1000, 64 * 1024, ::atoi(argv[2]) != 0, ::atoi(argv[3]) != 0);
+        return 0;
+    }
+    size_t max_threads = argc > 1 ? ::atoi(argv[1]) : std::thread::hardware_concurrency();
+    if (max_threads == 0)
+    {
+        max_threads = 1;
+    }
+
+    BenchPingPong(1000000);
+    BenchCreateRunDestroy(1000000, false);
+    BenchCreateRunDestroy(1000000, true);
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        BenchYieldStorm(threads, 1000, 1000);
+    }
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        BenchSpawnTree(threads, 16, false);
+        BenchSpawnTree(threads, 16, true);
+    }
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        BenchTinyTasks(threads, 1000000, false);
+        BenchTinyTasks(threads, 1000000, true);
+    }
+    BenchIdleCPU(max_threads, 500);
+    BenchWakeLatency(max_threads, 200, 2000);
+    BenchWakeLatency(max_threads, 200, 0);
+    RunInFreshProcess({"--memory", "0"});
+    RunInFreshProcess({"--memory", "1"});
+    RunInFreshProcess({"--stack-touch", "0", "0"});
+    RunInFreshProcess({"--stack-touch", "1", "0"});
+    RunInFreshProcess({"--stack-touch", "1", "1"});
+    return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * fork-join 并行算法的扩展性基准测试
+ * 线程数量从 1 开始按 2 的幂增加到最大线程数，结果以 JSON Lines 格式输出到标准输出，
+ * speedup 为相对单线程的加速比。
+ * 用法: bench_parallel [最大线程数，默认 64]
+*/
+#include "log.h"
+#include "parallel.h"
+#include "scheduler.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double ElapsedNS(Clock::time_point begin)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+}
+
+// 每个测试单线程时的耗时，用于计算加速比
+static std::map<std::string, double>& Baselines()
+{
+    static std::map<std::string, double> s_baselines;
+    return s_baselines;
+}
+
+static void Report(const char* bench, size_t threads, uint64_t ops, double total_ns)
+{
+    double& baseline = Baselines()[bench];
+    if (threads == 1)
+    {
+        baseline = total_ns;
+    }
+    ::printf("{\"bench\":\"%s\",\"threads\":%zu,\"ops\":%lu,\"total_ns\":%.0f,\"ns_per_op\":%.2f,"
+             "\"speedup\":%.2f}\n",
+             bench, threads, static_cast<unsigned long>(ops), total_ns, ops ? total_ns / ops : 0.0,
+             baseline > 0 ? baseline / total_ns : 0.0);
+    ::fflush(stdout);
+}
+
+// 每个元素做少量浮点运算，测试切块与调度的开销
+static void BenchFor(Scheduler& scheduler, size_t threads, std::vector<double>& data)
+{
+    auto begin = Clock::now();
+    ParallelFor(&scheduler, size_t(0), data.size(),
+                [&data](size_t i) { data[i] = std::sqrt(data[i] * 1.0001 + 1.0); });
+    Report("parallel_for", threads, data.size(), ElapsedNS(begin));
+}
+
+// 传感器的统计量：样本数、均值与 M2（Welford 算法，可以合并）
+struct SensorStats
+{
+    uint64_t count = 0;
+    double mean = 0;
+    double m2 = 0;
+
+    static SensorStats Merge(const SensorStats& a, const SensorStats& b)
+    {
+        if (a.count == 0 || b.count == 0)
+        {
+            return a.count ? a : b;
+        }
+        SensorStats result;
+        result.count = a.count + b.count;
+        const double delta = b.mean - a.mean;
+        result.mean = a.mean + delta * b.count / result.count;
+        result.m2 = a.m2 + b.m2 + delta * delta * a.count * b.count / result.count;
+        return result;
+    }
+};
+
+// 按传感器分批计算统计量：每个传感器一段连续的样本
+static void BenchReduce(Scheduler& scheduler, size_t threads, const std::vector<double>& samples,
+                        size_t sensors)
+{
+    const size_t per_sensor = samples.size() / sensors;
+    auto begin = Clock::now();
+    std::vector<SensorStats> result(sensors);
+    ParallelFor(&scheduler, size_t(0), sensors, [&](size_t sensor) {
+        SensorStats stats;
+        for (size_t i = sensor * per_sensor; i < (sensor + 1) * per_sensor; ++i)
+        {
+            ++stats.count;
+            const double delta = samples[i] - stats.mean;
+            stats.mean += delta / stats.count;
+            stats.m2 += delta * (samples[i] - stats.mean);
+        }
+        result[sensor] = stats;
+    });
+    // 所有样本的总体统计量
+    SensorStats total = ParallelReduce(&scheduler, size_t(0), sensors, SensorStats(),
+                                       [&result](size_t i) { return result[i]; },
+                                       &SensorStats::Merge);
+    Report("parallel_reduce", threads, samples.size(), ElapsedNS(begin));
+    if (total.count != per_sensor * sensors)
+    {
+        ::fprintf(stderr, "parallel_reduce: unexpected count %lu\n",
+                  static_cast<unsigned long>(total.count));
+    }
+}
+
+static void BenchSort(Scheduler& scheduler, size_t threads, const std::vector<uint32_t>& input)
+{
+    std::vector<uint32_t> data(input);
+    auto begin = Clock::now();
+    ParallelSort(&scheduler, data.begin(), data.end());
+    Report("parallel_sort", threads, data.size(), ElapsedNS(begin));
+    if (!std::is_sorted(data.begin(), data.end()))
+    {
+        ::fprintf(stderr, "parallel_sort: result is not sorted\n");
+    }
+}
+
+// 递归地并行调用两个子问题
+static uint64_t Fib(Scheduler* scheduler, int n)
+{
+    if (n < 20)
+    {
+        return n < 2 ? n : Fib(nullptr, n - 1) + Fib(nullptr, n - 2);
+    }
+    uint64_t a = 0;
+    uint64_t b = 0;
+    ParallelInvoke(scheduler, [&]() { a = Fib(scheduler, n - 1); },
+                   [&]() { b = Fib(scheduler, n - 2); });
+    return a + b;
+}
+
+static void BenchInvoke(Scheduler& scheduler, size_t threads, int n)
+{
+    auto begin = Clock::now();
+    uint64_t result = Fib(&scheduler, n);
+    Report("parallel_invoke", threads, result, ElapsedNS(begin));
+}
+
+int main(int argc, char** argv)
+{
+    Log::set_log_level(LFATAL);
+    size_t max_threads = argc > 1 ? ::atoi(argv[1]) : 64;
+    if (max_threads == 0)
+    {
+        max_threads = 1;
+    }
+
+    std::mt19937 rng(42);
+    std::vector<double> data(1 << 24);
+    for (auto& value : data)
+    {
+        value = static_cast<double>(rng() % 1000);
+    }
+    std::vector<uint32_t> keys(1 << 23);
+    for (auto& key : keys)
+    {
+        key = rng();
+    }
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        // 调用者作为外部线程参与执行，调度器的所有线程都可以运行辅助任务
+        Scheduler scheduler(threads, false, "parallel");
+        scheduler.start();
+        BenchFor(scheduler, threads, data);
+        BenchReduce(scheduler, threads, data, 4096);
+        BenchSort(scheduler, threads, keys);
+        BenchInvoke(scheduler, threads, 30);
+        scheduler.stop();
+    }
+    return 0;
+}
@@ -0,0 +1,204 @@
+#ifndef __BLOCKING_EXECUTOR_H__
+#define __BLOCKING_EXECUTOR_H__
+
+#include "config.h"
+#include "fiber.h"
+#include "inline_function.h"
+#include "scheduler.h"
+#include "singleton.h"
+#include "thread.h"
+#include <deque>
+#include <exception>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace BlockingInfo
+{
+// 执行阻塞操作的线程数量上限，超过上限的操作排队等待
+static ConfigVar<uint64_t>::ptr g_max_threads =
+    Config::Lookup<uint64_t>("blocking.max_threads", 64);
+// 空闲线程等待新操作的最长时间（毫秒），超时后退出
+static ConfigVar<uint64_t>::ptr g_keep_alive_ms =
+    Config::Lookup<uint64_t>("blocking.keep_alive_ms", 10000);
+} // namespace BlockingInfo
+
+namespace BlockingDetail
+{
+
+// 阻塞操作的返回值或者异常，保存在等待协程的栈上
+// 返回值在操作结束时直接由 func() 的结果构造，不要求返回类型可以默认构造或者赋值
+template <typename R>
+struct Result
+{
+    using Value = typename std::decay<R>::type;
+
+    Result() {}
+
+    ~Result()
+    {
+        if (has_value)
+        {
+            value.~Value();
+        }
+    }
+
+    template <typename F>
+    void capture(F& func)
+    {
+        try
+        {
+            new (&value) Value(func());
+            has_value = true;
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+    }
+
+    R get()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+        return std::move(value);
+    }
+
+    union
+    {
+        Value value;
+    };
+    bool has_value = false;
+    std::exception_ptr exception;
+};
+
+template <>
+struct Result<void>
+{
+    std::exception_ptr exception;
+
+    template <typename F>
+    void capture(F& func)
+    {
+        try
+        {
+            func();
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+    }
+
+    void get()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+} // namespace BlockingDetail
+
+/**
+ * @brief 执行阻塞操作的弹性线程池
+ * 协程中的阻塞调用（文件读写、目录遍历、system 等）会占住整个调度线程，
+ * 通过 run 把操作交给本线程池执行：当前协程挂起，调度线程继续执行其他任务，
+ * 操作完成后协程被重新加入原调度器。
+ * 线程按需创建，数量不超过 max_threads，空闲超过 keep_alive_ms 的线程自动退出。
+ * 全局实例通过 Singleton<BlockingExecutor>::get_instance() 获取，参数来自 "blocking.*" 配置。
+*/
+class BlockingExecutor : public noncopyable
+{
+public:
+    using Job = InlineFunction;
+
+    /**
+     * @brief 构造函数
+     * @param max_threads 线程数量上限
+     * @param keep_alive_ms 空闲线程的存活时间（毫秒）
+     * @param name 线程名称前缀
+     * */
+    explicit BlockingExecutor(size_t max_threads = BlockingInfo::g_max_threads->getValue(),
+                              uint64_t keep_alive_ms = BlockingInfo::g_keep_alive_ms->getValue(),
+                              std::string name = "blocking");
+    // 执行完已经提交的操作，等待所有线程退出
+    ~BlockingExecutor();
+
+    /**
+     * @brief 提交操作，不等待结果 thread-safe
+     * 没有空闲线程并且未达到线程上限时创建新线程，否则排队等待
+     * */
+    void submit(Job job);
+
+    /**
+     * @brief 在线程池中执行阻塞操作并返回结果
+     * 在调度器的协程中调用时挂起当前协程，操作完成后在原调度器上恢复；
+     * 不在调度器的协程中（包括 use_caller 时构造调度器的线程与通过 Scheduler::scheduleInline 提交的任务）时
+     * 直接在当前线程执行。
+     * 操作抛出的异常在调用者中重新抛出。与其他挂起的协程一样，等待中的协程不计入调度器的任务，
+     * 停止调度器之前需要等待操作完成
+     * */
+    template <typename F>
+    auto run(F&& func) -> decltype(func())
+    {
+        using R = decltype(func());
+        static_assert(!std::is_reference<R>::value, "阻塞操作不能返回引用");
+        if (!Fiber::InSchedulerFiber())
+        {
+            return func();
+        }
+        Scheduler* scheduler = Scheduler::GetThis();
+        BlockingDetail::Result<R> result;
+        // 操作与结果都位于挂起的协程栈上，协程恢复之前一直有效
+        submit([&func, &result, scheduler, self = Fiber::GetThis()]() mutable {
+            result.capture(func);
+            // 重新调度之后协程可能立即恢复并返回，不能再访问 func 与 result
+            scheduler->schedule(std::move(self));
+        });
+        Fiber::YieldToHold();
+        return result.get();
+    }
+
+    // 当前线程数量
+    size_t threadCount() const;
+    // 空闲线程数量
+    size_t idleCount() const;
+    // 排队等待执行的操作数量
+    size_t pendingCount() const;
+
+private:
+    // 线程池线程的执行函数
+    void workerMain();
+
+private:
+    const std::string m_name;
+    const size_t m_max_threads;
+    const uint64_t m_keep_alive_ms;
+    mutable Mutex m_mutex;
+    // 有新操作或者线程池停止时通知空闲线程
+    Condition m_job_cond;
+    // 最后一个线程退出时通知析构函数
+    Condition m_exit_cond;
+    std::deque<Job> m_jobs;
+    size_t m_thread_count = 0;
+    size_t m_idle_count = 0;
+    // 创建过的线程数量，用于线程命名
+    uint64_t m_spawned = 0;
+    bool m_stopping = false;
+};
+
+/**
+ * @brief 在全局的阻塞操作线程池中执行 func，当前协程挂起直到操作完成
+ * */
+template <typename F>
+auto BlockingCall(F&& func) -> decltype(func())
+{
+    return Singleton<BlockingExecutor>::get_instance().run(std::forward<F>(func));
+}
+
+#endif // __BLOCKING_EXECUTOR_H__
@@ -22,7 +22,7 @@
 class ConfigVarBase
 {
 public: 
-    using ptr = std::shared_ptr<ConfigVarBase> ptr;
+    using ptr = std::shared_ptr<ConfigVarBase>;
 
     ConfigVarBase(const std::string& name, const std::string& description)
         : m_name(name), m_description(description)
@@ -580,7 +580,7 @@ private:
 };
 
 /* util functional */
-std::ostream& operator<<(std::ostream& out, const ConfigVarBase& cvb) {
+inline std::ostream& operator<<(std::ostream& out, const ConfigVarBase& cvb) {
     out << cvb.getName() << ": " << cvb.toString();
     return out;
 }
@@ -0,0 +1,344 @@
+#ifndef __COROUTINE_H__
+#define __COROUTINE_H__
+
+/**
+ * 基于 C++20 无栈协程的异步任务
+ * Task<T> 不需要独立的协程栈，挂起后通过 Scheduler::scheduleInline 直接在工作线程的调度协程上恢复，
+ * 恢复时不占用 Fiber 也不切换上下文，与有栈协程 Fiber 共用同一组工作线程。
+ * 因此 Task 中不能调用会挂起 Fiber 的操作（FiberMutex 等同步原语会抛出 Exception，
+ * Future::get 等会阻塞整个工作线程），等待应当通过 co_await 完成。
+ * 需要以 C++20 编译（见 CMakeLists.txt 中的 ENABLE_CXX20 选项）。
+*/
+#if defined(__cpp_impl_coroutine)
+
+#include "log.h"
+#include "scheduler.h"
+#include "timer.h"
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+template <typename T = void>
+class Task;
+
+namespace CoroutineDetail
+{
+
+// 任务结束时的挂起点：恢复等待该任务的协程，分离执行的任务在这里销毁自身
+struct FinalAwaiter
+{
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+    {
+        auto& promise = handle.promise();
+        if (promise.continuation)
+        {
+            return promise.continuation;
+        }
+        if (promise.detached)
+        {
+            if (promise.exception)
+            {
+                try
+                {
+                    std::rethrow_exception(promise.exception);
+                }
+                catch (std::exception& e)
+                {
+                    ERROR("Task exception: %s", e.what());
+                }
+                catch (...)
+                {
+                    ERROR("Task exception");
+                }
+            }
+            handle.destroy();
+        }
+        return std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+};
+
+struct PromiseBase
+{
+    // 等待该任务结束的协程
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+    // 是否由 Spawn 分离执行，结束时自行销毁
+    bool detached = false;
+
+    // 惰性启动，被 co_await 或 Spawn 时才开始执行
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase
+{
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& result)
+    {
+        value.emplace(std::forward<U>(result));
+    }
+
+    T result()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase
+{
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+} // namespace CoroutineDetail
+
+/**
+ * @brief 无栈协程任务
+ * 在协程中 co_await 一个 Task 会启动该任务，并在任务结束后恢复等待者；
+ * 在协程之外通过 Spawn 交给调度器执行，或者在 Fiber 中通过 FiberAwait 等待结果。
+*/
+template <typename T>
+class Task : public noncopyable
+{
+public:
+    using promise_type = CoroutineDetail::Promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    explicit Task(handle_type handle)
+        : m_handle(handle) {}
+
+    Task(Task&& rhs) noexcept
+        : m_handle(std::exchange(rhs.m_handle, nullptr)) {}
+
+    Task& operator=(Task&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(rhs.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    bool valid() const { return static_cast<bool>(m_handle); }
+    bool done() const { return !m_handle || m_handle.done(); }
+
+    bool await_ready() const noexcept { return done(); }
+
+    // 记录等待者并直接切换到该任务执行
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+
+    T await_resume() { return m_handle.promise().result(); }
+
+    // 放弃所有权，返回协程句柄
+    handle_type release() { return std::exchange(m_handle, nullptr); }
+
+private:
+    handle_type m_handle;
+};
+
+namespace CoroutineDetail
+{
+
+template <typename T>
+Task<T> Promise<T>::get_return_object()
+{
+    return Task<T>(Task<T>::handle_type::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object()
+{
+    return Task<void>(Task<void>::handle_type::from_promise(*this));
+}
+
+} // namespace CoroutineDetail
+
+/**
+ * @brief 分离执行任务，任务在调度器的工作线程上启动，结束时自行销毁
+ * @param scheduler 执行任务的调度器
+ * @param task 要执行的任务，返回值被丢弃，未捕获的异常会被记录到日志
+ * @param thread_id 任务要绑定执行线程的 id
+ * */
+template <typename T>
+void Spawn(Scheduler* scheduler, Task<T> task, long thread_id = -1)
+{
+    assert(scheduler);
+    auto handle = task.release();
+    handle.promise().detached = true;
+    scheduler->scheduleInline([handle]() { handle.resume(); }, thread_id);
+}
+
+/**
+ * @brief 挂起当前协程，通过 Scheduler::scheduleInline 在指定调度器上恢复执行
+ * co_await ScheduleOn(Scheduler::GetThis()) 相当于 Fiber 的让出执行权
+*/
+class ScheduleOn
+{
+public:
+    explicit ScheduleOn(Scheduler* scheduler, long thread_id = -1)
+        : m_scheduler(scheduler), m_thread_id(thread_id) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        assert(m_scheduler);
+        m_scheduler->scheduleInline([handle]() { handle.resume(); }, m_thread_id);
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    Scheduler* m_scheduler;
+    long m_thread_id;
+};
+
+/**
+ * @brief 定时器等待：挂起当前协程，超时后在挂起时所在的调度器上恢复执行
+*/
+class SleepFor
+{
+public:
+    /**
+     * @param manager 定时器管理器
+     * @param ms 等待的毫秒数
+     * */
+    SleepFor(TimerManager* manager, uint64_t ms)
+        : m_manager(manager), m_ms(ms) {}
+
+    bool await_ready() const noexcept { return m_ms == 0; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        assert(m_manager);
+        Scheduler* scheduler = Scheduler::GetThis();
+        m_manager->addTimer(m_ms, [scheduler, handle]() {
+            if (scheduler)
+            {
+                scheduler->scheduleInline([handle]() { handle.resume(); });
+            }
+            else
+            {
+                handle.resume();
+            }
+        });
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    TimerManager* m_manager;
+    uint64_t m_ms;
+};
+
+namespace CoroutineDetail
+{
+
+template <typename T>
+struct FiberAwaitResult
+{
+    std::optional<T> value;
+    std::exception_ptr exception;
+};
+
+template <>
+struct FiberAwaitResult<void>
+{
+    std::exception_ptr exception;
+};
+
+// 等待任务结束，保存结果后重新调度等待中的 Fiber
+template <typename T>
+Task<void> FiberAwaitDriver(Task<T> task, FiberAwaitResult<T>* result,
+                            Scheduler* scheduler, Fiber::ptr fiber)
+{
+    try
+    {
+        if constexpr (std::is_void<T>::value)
+        {
+            co_await task;
+        }
+        else
+        {
+            result->value.emplace(co_await task);
+        }
+    }
+    catch (...)
+    {
+        result->exception = std::current_exception();
+    }
+    scheduler->schedule(std::move(fiber));
+}
+
+} // namespace CoroutineDetail
+
+/**
+ * @brief 在 Fiber 中等待任务的结果
+ * 只挂起当前 Fiber，不阻塞工作线程，任务结束后 Fiber 被重新调度
+ * */
+template <typename T>
+T FiberAwait(Task<T> task)
+{
+    Fiber::CheckYieldable();
+    assert(Fiber::InSchedulerFiber() && "只能在调度器中的协程里等待");
+    Scheduler* scheduler = Scheduler::GetThis();
+    CoroutineDetail::FiberAwaitResult<T> result;
+    Spawn(scheduler, CoroutineDetail::FiberAwaitDriver(std::move(task), &result,
+                                                       scheduler, Fiber::GetThis()));
+    Fiber::YieldToHold();
+    if (result.exception)
+    {
+        std::rethrow_exception(result.exception);
+    }
+    if constexpr (!std::is_void<T>::value)
+    {
+        return std::move(*result.value);
+    }
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // __COROUTINE_H__
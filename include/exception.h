@@ -44,8 +44,8 @@ class SystemError : public Exception
 {
 public:
     explicit SystemError(std::string what = ""): 
-    Exception(what + " : " + std::string(::strerror(errno)));
-}
+    Exception(what + " : " + std::string(::strerror(errno))) {}
+};
 
 
 #endif // __EXCEPTION_H__
@@ -2,20 +2,27 @@
 #define __FIBER_H__
 
 #include "config.h"
+#include "fiber_context.h"
 #include "thread.h"
 #include <atomic>
+#include <cassert>
 #include <functional>
 #include <memory>
+#include <typeinfo>
 #include <ucontext.h>
 
 class Scheduler;
+template <typename T>
+class FiberLocal;
 
 /**
  * @brief 协程类
 */
-class Fiber : public std::enable_shared_from_this<Fiber>, public zjl::noncopyable
+class Fiber : public std::enable_shared_from_this<Fiber>, public noncopyable
 {
     friend class Scheduler;
+    template <typename T>
+    friend class FiberLocal;
 public:
     using ptr = std::shared_ptr<Fiber>;
     using uptr = std::unique_ptr<Fiber>;
@@ -37,8 +44,12 @@ public:
      * @brief 创建新协程
      * @param callback 协程执行函数
      * @param 协程栈大小，如果传 0，使用配置项 "fiber.stack_size" 定义的值
+     * @param shared_stack 是否运行在线程共享栈上（仅汇编上下文切换可用，否则忽略）。
+     *        共享栈协程挂起后只保存实际使用的栈空间，首次运行后即绑定到该线程，之后只能在该线程上调度，
+     *        直到执行结束后 reset()。通过 Scheduler::schedule 提交时自动绑定到该线程，
+     *        指定其他线程时抛出 Exception；绑定的线程退出后（例如弹性模式下退出的工作线程）协程不能再被调度
      * */
-    explicit Fiber(FiberFunc callback, size_t stack_size = 0);
+    explicit Fiber(FiberFunc callback, size_t stack_size = 0, bool shared_stack = false);
 //    Fiber(const Fiber& rhs);
     ~Fiber();
 
@@ -73,7 +84,7 @@ public:
     uint64_t getID() const { return m_id; }
 
     // 获取协程状态
-    State getState() const { return m_state; }
+    State getState() const { return m_state.load(std::memory_order_acquire); }
 
     // 判断协程是否执行结束
     bool finish() const noexcept;
@@ -82,6 +93,31 @@ private:
     // 用于创建 master fiber
     Fiber();
 
+    // 在协程栈上初始化上下文，入口函数为 MainFunc
+    void makeContext();
+    // 保存当前上下文到 from，并切换到 to 的上下文
+    static void SwapContext(Fiber* from, Fiber* to);
+
+    // 线程共享栈
+    struct SharedStack;
+    // 获取当前线程的共享栈，首次调用时分配
+    static const std::shared_ptr<SharedStack>& GetSharedStack();
+    // 共享栈模式：切换进入前占用当前线程的共享栈，必要时换出原占用者并恢复自身的栈内容
+    void occupySharedStack();
+    // 共享栈模式：将挂起协程已使用的栈空间复制到私有缓冲区
+    void saveSharedStack();
+    // 共享栈模式：释放对共享栈的占用
+    void releaseSharedStack();
+    // 共享栈模式下绑定的线程 id，尚未绑定或者不是共享栈协程时为 -1，调度器据此固定执行线程
+    long sharedStackThread() const { return m_shared_thread; }
+
+    // 栈使用量统计：开启时用填充模式覆盖协程栈，记录入口函数类型
+    void prepareStackProfile();
+    // 栈使用量统计：协程结束时扫描栈的最大使用量并汇总
+    void recordStackProfile();
+    // 执行函数只是转发调用时，由调度器设置实际任务的类型，用于栈使用量统计与运行时间统计
+    void setEntryType(const std::type_info& type);
+
 public:
     // 获取当前正在执行的 fiber 的智能指针，如果不存在，则在当前线程上创建 master fiber
     static Fiber::ptr GetThis();
@@ -91,44 +127,219 @@ public:
     static void Yield();
     // 挂起当前协程，转换为 HOLD 状态，等待下一次调度
     static void YieldToHold();
+    // 当前协程不能让出执行权（不在 InSchedulerFiber() 定义的协程中，例如 use_caller 时构造调度器的线程、
+    // Scheduler::scheduleInline 提交的任务）时抛出 Exception，挂起前需要先登记等待者的同步原语在修改任何状态之前调用
+    static void CheckYieldable();
+    // 当前是否在调度器管理、拥有独立协程栈的协程中，只有这时等待可以挂起当前协程。
+    // 线程的 master fiber、use_caller 时的调度协程以及通过 Scheduler::scheduleInline 提交的任务都不是，
+    // 这些调用者需要阻塞当前线程等待
+    static bool InSchedulerFiber();
+    /**
+     * @brief 抢占检查点，供长时间计算的循环定期调用
+     * 当前协程连续运行超过 "scheduler.watchdog.time_slice_ms" 时，调度器的监控线程设置抢占请求，
+     * 本函数看到请求后让出执行权并重新加入调度器的任务队列，否则只读取一次标志后立即返回。
+     * 不在调度器的协程中（包括通过 Scheduler::scheduleInline 提交的任务）时不会让出
+     * @return 是否让出了执行权
+     * */
+    static bool MaybeYield();
     // 获取存在的协程数量
     static uint64_t TotalFiber();
     // 获取当前协程 id
     static uint64_t GetFiberID();
     // 协程入口函数
     static void MainFunc();
+    /**
+     * @brief 从当前线程的协程池中取出一个协程并通过 reset() 绑定执行函数，池为空时创建新协程
+     * @param callback 协程执行函数
+     * */
+    static Fiber::ptr Acquire(FiberFunc callback);
+    /**
+     * @brief 将执行结束的协程归还到当前线程的协程池
+     * 只回收使用默认栈大小、处于结束状态且没有其他持有者的协程，其余情况直接释放
+     * */
+    static void Recycle(Fiber::ptr fiber);
+
+    // 协程局部存储的槽位数量上限
+    static constexpr size_t kLocalSlotCount = 16;
+
+private:
+    /**
+     * @brief 分配一个协程局部存储槽位，槽位在进程生命周期内不会回收
+     * @param destructor 协程结束或 reset() 时用于销毁槽位中的值
+     * */
+    static size_t AllocLocalSlot(void (*destructor)(void*));
+    // 销毁所有协程局部存储的值
+    void clearLocals();
+    // 修改协程状态：release 语义保证其他线程看到 HOLD 时上下文已经保存，不需要更强的顺序
+    void setState(State state) { m_state.store(state, std::memory_order_release); }
 
 private:
     // 协程 id
     uint64_t m_id;
     // 协程栈大小
     uint64_t m_stack_size;
-    // 协程状态
-    State m_state;
+    // 协程状态，调度器的其他线程会读取该状态判断协程是否已经挂起
+    std::atomic<State> m_state;
     // 协程上下文
+#if FIBER_USE_ASM_CONTEXT
+    // 挂起时保存的栈顶指针
+    void* m_ctx;
+#else
     ucontext_t m_ctx;
+#endif
     // 协程栈空间指针
     void* m_stack;
+    // 协程栈是否使用透明大页
+    bool m_stack_hugepage;
     // 协程执行函数
     FiberFunc m_callback;
+    // 是否运行在线程共享栈上
+    bool m_shared_stack;
+    // 共享栈模式下绑定的线程共享栈，首次运行时设置。绑定的协程共同持有共享栈，
+    // 线程退出后共享栈在最后一个绑定的协程释放时才销毁
+    std::shared_ptr<SharedStack> m_shared_owner;
+    // 共享栈模式下绑定的线程 id
+    long m_shared_thread;
+    // 共享栈模式下保存栈内容的私有缓冲区
+    char* m_save_buffer;
+    // 私有缓冲区中已保存的栈内容大小
+    size_t m_save_size;
+    // 私有缓冲区容量
+    size_t m_save_capacity;
+    // 栈使用量统计时记录的入口函数类型，为空表示未开启统计
+    const std::type_info* m_entry_type;
+    // 上一次统计到的栈使用量，复用协程时只需要重新填充这部分栈空间
+    size_t m_stack_used;
+    // 协程局部存储，按 FiberLocal 分配的槽位下标访问
+    void* m_locals[kLocalSlotCount];
+    // 入口函数类型，用于运行时间统计与 watchdog 报告
+    const std::type_info* m_run_entry = &typeid(void);
+#ifdef FIBER_ACCOUNTING
+    // 运行时间统计：累计运行时间（纳秒）
+    uint64_t m_run_ns = 0;
+    // 运行时间统计：被换入的次数
+    uint64_t m_switch_count = 0;
+    // 运行时间统计：最近一次被换入的时间戳
+    uint64_t m_swap_in_ns = 0;
+#endif
 };
 
 namespace FiberInfo
 {
 
+// 以下运行时状态在 fiber.cpp 中定义，所有编译单元共享同一份
+
 // 最后一个协程的 id
-static std::atomic_uint64_t s_fiber_id{0};
+extern std::atomic_uint64_t s_fiber_id;
 // 存在的协程数量
-static std::atomic_uint64_t s_fiber_count{0};
+extern std::atomic_uint64_t s_fiber_count;
 
 // 当前线程正在执行的协程
-static thread_local Fiber* t_fiber = nullptr;
+extern thread_local Fiber* t_fiber;
 // 当前线程的主协程
-static thread_local Fiber::ptr t_master_fiber{};
+extern thread_local Fiber::ptr t_master_fiber;
 
 // 协程栈大小配置项
 static ConfigVar<uint64_t>::ptr g_fiber_stack_size =
     Config::Lookup<uint64_t>("fiber.stack_size", 1024 * 1024);
+// 是否为每个协程预留 fiber.stack_reserve_size 大小的栈，物理内存在访问时才分配
+static ConfigVar<bool>::ptr g_stack_reserve =
+    Config::Lookup<bool>("fiber.stack_reserve", false);
+// 预留模式下每个协程栈的虚拟地址空间大小
+static ConfigVar<uint64_t>::ptr g_stack_reserve_size =
+    Config::Lookup<uint64_t>("fiber.stack_reserve_size", 8 * 1024 * 1024);
+// 新分配的协程栈是否使用透明大页，适合计算密集、栈访问频繁的协程
+static ConfigVar<bool>::ptr g_stack_hugepage =
+    Config::Lookup<bool>("fiber.stack_hugepage", false);
+// 每个线程每个尺寸等级保留物理内存的空闲栈数量
+static ConfigVar<uint64_t>::ptr g_stack_pool_hot_count =
+    Config::Lookup<uint64_t>("fiber.stack_pool.hot_count", 64);
+// 每个线程每个尺寸等级缓存的空闲栈上限，超出的栈直接 munmap
+static ConfigVar<uint64_t>::ptr g_stack_pool_max_count =
+    Config::Lookup<uint64_t>("fiber.stack_pool.max_count", 1024);
+// 超出 hot_count 的空闲栈是否 MADV_DONTNEED 归还物理内存
+static ConfigVar<bool>::ptr g_stack_pool_madvise =
+    Config::Lookup<bool>("fiber.stack_pool.madvise", true);
+// 每个线程协程池缓存的协程数量上限
+static ConfigVar<uint64_t>::ptr g_fiber_pool_size =
+    Config::Lookup<uint64_t>("fiber.pool_size", 256);
+// 是否统计协程栈的最大使用量，开启后创建协程时需要填充整个协程栈，仅用于调优 fiber.stack_size
+static ConfigVar<bool>::ptr g_stack_profile =
+    Config::Lookup<bool>("fiber.stack_profile", false);
+// 每个线程共享栈的大小
+static ConfigVar<uint64_t>::ptr g_shared_stack_size =
+    Config::Lookup<uint64_t>("fiber.shared_stack_size", 8 * 1024 * 1024);
 } // namespace FiberInfo
 
+/**
+ * @brief 协程局部存储
+ * 应在程序启动时以全局或静态变量的形式创建，每个实例占用一个槽位，
+ * 通过 FiberInfo::t_fiber 与槽位下标 O(1) 访问当前协程的值。
+ * 值在首次访问时默认构造，协程结束（TERM）或 reset() 时析构。
+*/
+template <typename T>
+class FiberLocal : public noncopyable
+{
+public:
+    FiberLocal()
+        : m_slot(Fiber::AllocLocalSlot(&FiberLocal::Destroy)) {}
+
+    // 获取当前协程的值，不存在时默认构造
+    T& get()
+    {
+        void*& value = slot();
+        if (value == nullptr)
+        {
+            value = new T();
+        }
+        return *static_cast<T*>(value);
+    }
+
+    // 获取当前协程的值，不存在时返回 nullptr
+    T* tryGet()
+    {
+        return static_cast<T*>(slot());
+    }
+
+    // 设置当前协程的值
+    void set(T value)
+    {
+        void*& old_value = slot();
+        if (old_value)
+        {
+            *static_cast<T*>(old_value) = std::move(value);
+        }
+        else
+        {
+            old_value = new T(std::move(value));
+        }
+    }
+
+    // 提前销毁当前协程的值
+    void reset()
+    {
+        void*& value = slot();
+        Destroy(value);
+        value = nullptr;
+    }
+
+    T& operator*() { return get(); }
+    T* operator->() { return &get(); }
+
+private:
+    void*& slot()
+    {
+        assert(FiberInfo::t_fiber && "当前线程不存在协程");
+        return FiberInfo::t_fiber->m_locals[m_slot];
+    }
+
+    static void Destroy(void* value)
+    {
+        delete static_cast<T*>(value);
+    }
+
+private:
+    const size_t m_slot;
+};
+
 #endif // __FIBER_H__
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef __FIBER_CONTEXT_H__
+#define __FIBER_CONTEXT_H__
+
+#include <cstddef>
+
+/**
+ * 协程上下文切换的汇编实现，参考 boost.context 的 jump_fcontext。
+ * 只保存 ABI 规定的 callee-saved 寄存器，不像 swapcontext 那样保存整个 ucontext_t，
+ * 也不会调用 rt_sigprocmask 系统调用。
+ * 编译时定义 FIBER_CONTEXT_ASM 开启（见 CMakeLists.txt 中的同名选项），
+ * 仅支持 x86-64 与 aarch64，其他平台回退到 ucontext 实现。
+*/
+#if defined(FIBER_CONTEXT_ASM) && (defined(__x86_64__) || defined(__aarch64__))
+#define FIBER_USE_ASM_CONTEXT 1
+#else
+#define FIBER_USE_ASM_CONTEXT 0
+#endif
+
+#if FIBER_USE_ASM_CONTEXT
+
+extern "C" {
+/**
+ * @brief 保存当前上下文并切换到目标上下文
+ * @param from_sp 保存当前上下文栈顶指针的位置
+ * @param to_sp 目标上下文的栈顶指针
+ * */
+void fiber_context_swap(void** from_sp, void* to_sp);
+}
+
+/**
+ * @brief 在给定的栈空间上构造初始上下文，首次切换进入时调用 entry
+ * @param stack 栈空间的起始（低）地址
+ * @param size 栈空间大小
+ * @param entry 入口函数，不允许返回
+ * @return 可传给 fiber_context_swap 的栈顶指针
+ * */
+void* fiber_context_make(void* stack, size_t size, void (*entry)());
+
+#endif // FIBER_USE_ASM_CONTEXT
+
+#endif // __FIBER_CONTEXT_H__
@@ -0,0 +1,238 @@
+#ifndef __FIBER_SYNC_H__
+#define __FIBER_SYNC_H__
+
+#include "fiber.h"
+#include "thread.h"
+#include <deque>
+#include <utility>
+
+class Scheduler;
+
+/**
+ * 协程级别的同步原语
+ * 等待时只挂起当前协程（Fiber::YieldToHold），不阻塞所在的工作线程，
+ * 被唤醒时通过 Scheduler::schedule 将协程重新加入原调度器的任务队列。
+ * 只能在调度器管理的协程中调用可能挂起的方法，其他调用者（包括 use_caller 时构造调度器的线程）
+ * 需要挂起时抛出 Exception，不挂起的方法（tryLock、notify、trySend 等）可以在任何线程调用。
+*/
+
+/**
+ * @brief 协程等待队列
+ * non-thread-safe，由使用者加锁保护
+*/
+class FiberWaitQueue
+{
+public:
+    // 将当前协程加入等待队列，调用者随后需要释放锁并调用 Fiber::YieldToHold()。
+    // 当前协程不能挂起时抛出 Exception，队列与调用者的状态都不会改变
+    void push();
+    // 唤醒一个等待的协程，返回是否存在等待者
+    bool notifyOne();
+    // 唤醒所有等待的协程，返回唤醒的数量
+    size_t notifyAll();
+    bool empty() const { return m_waiters.empty(); }
+    size_t size() const { return m_waiters.size(); }
+
+private:
+    // 等待的协程及其所属的调度器
+    std::deque<std::pair<Scheduler*, Fiber::ptr>> m_waiters;
+};
+
+/**
+ * @brief 协程互斥量
+ * unlock 时锁的所有权直接交给等待队列中的第一个协程，按 FIFO 顺序获得锁
+*/
+class FiberMutex : public noncopyable
+{
+public:
+    void lock();
+    bool tryLock();
+    void unlock();
+
+private:
+    Mutex m_mutex;
+    bool m_locked = false;
+    FiberWaitQueue m_waiters;
+};
+
+using FiberScopedLock = ScopedLockImpl<FiberMutex>;
+
+/**
+ * @brief 协程条件变量，配合 FiberMutex 使用
+*/
+class FiberCondition : public noncopyable
+{
+public:
+    // 释放 mutex 并挂起当前协程，被唤醒后重新获得 mutex
+    void wait(FiberMutex& mutex);
+    // 等待直到 predicate 返回 true
+    template <typename Predicate>
+    void wait(FiberMutex& mutex, Predicate predicate)
+    {
+        while (!predicate())
+        {
+            wait(mutex);
+        }
+    }
+    void notifyOne();
+    void notifyAll();
+
+private:
+    Mutex m_mutex;
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 协程计数信号量
+*/
+class FiberSemaphore : public noncopyable
+{
+public:
+    explicit FiberSemaphore(size_t count = 0);
+    // -1，值为零时挂起当前协程
+    void wait();
+    // 值大于零时 -1 并返回 true，否则立即返回 false
+    bool tryWait();
+    // +1，存在等待者时直接唤醒一个等待者
+    void notify();
+
+private:
+    Mutex m_mutex;
+    size_t m_count;
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 有界多生产者多消费者通道
+ * 队列满时 send 挂起发送协程，队列空时 recv 挂起接收协程。
+ * trySend/tryRecv 不会挂起，可以轮询多个通道实现 select 风格的多路操作。
+*/
+template <typename T>
+class Channel : public noncopyable
+{
+public:
+    // 非阻塞操作的结果
+    enum Status
+    {
+        OK,     // 成功
+        EMPTY,  // 通道为空
+        FULL,   // 通道已满
+        CLOSED  // 通道已关闭
+    };
+
+    explicit Channel(size_t capacity)
+        : m_capacity(capacity == 0 ? 1 : capacity) {}
+
+    /**
+     * @brief 发送数据，通道已满时挂起当前协程
+     * @return 通道已关闭时返回 false
+     * */
+    bool send(T value)
+    {
+        ScopedLock lock(&m_mutex);
+        while (!m_closed && m_buffer.size() >= m_capacity)
+        {
+            m_senders.push();
+            lock.unlock();
+            Fiber::YieldToHold();
+            lock.lock();
+        }
+        if (m_closed)
+        {
+            return false;
+        }
+        m_buffer.push_back(std::move(value));
+        m_receivers.notifyOne();
+        return true;
+    }
+
+    /**
+     * @brief 接收数据，通道为空时挂起当前协程
+     * @return 通道已关闭并且没有剩余数据时返回 false
+     * */
+    bool recv(T& value)
+    {
+        ScopedLock lock(&m_mutex);
+        while (!m_closed && m_buffer.empty())
+        {
+            m_receivers.push();
+            lock.unlock();
+            Fiber::YieldToHold();
+            lock.lock();
+        }
+        if (m_buffer.empty())
+        {
+            return false;
+        }
+        value = std::move(m_buffer.front());
+        m_buffer.pop_front();
+        m_senders.notifyOne();
+        return true;
+    }
+
+    // 非阻塞发送，通道已满时 value 保持不变
+    Status trySend(T& value)
+    {
+        ScopedLock lock(&m_mutex);
+        if (m_closed)
+        {
+            return CLOSED;
+        }
+        if (m_buffer.size() >= m_capacity)
+        {
+            return FULL;
+        }
+        m_buffer.push_back(std::move(value));
+        m_receivers.notifyOne();
+        return OK;
+    }
+
+    // 非阻塞接收
+    Status tryRecv(T& value)
+    {
+        ScopedLock lock(&m_mutex);
+        if (m_buffer.empty())
+        {
+            return m_closed ? CLOSED : EMPTY;
+        }
+        value = std::move(m_buffer.front());
+        m_buffer.pop_front();
+        m_senders.notifyOne();
+        return OK;
+    }
+
+    // 关闭通道，唤醒所有等待的协程。关闭后不能再发送，剩余的数据仍可接收
+    void close()
+    {
+        ScopedLock lock(&m_mutex);
+        m_closed = true;
+        m_senders.notifyAll();
+        m_receivers.notifyAll();
+    }
+
+    bool isClosed() const
+    {
+        ScopedLock lock(&m_mutex);
+        return m_closed;
+    }
+
+    size_t size() const
+    {
+        ScopedLock lock(&m_mutex);
+        return m_buffer.size();
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    const size_t m_capacity;
+    mutable Mutex m_mutex;
+    bool m_closed = false;
+    std::deque<T> m_buffer;
+    // 等待发送的协程
+    FiberWaitQueue m_senders;
+    // 等待接收的协程
+    FiberWaitQueue m_receivers;
+};
+
+#endif // __FIBER_SYNC_H__
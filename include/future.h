@@ -0,0 +1,744 @@
+#ifndef __FUTURE_H__
+#define __FUTURE_H__
+
+/**
+ * 面向协程的 Future/Promise
+ * Promise 设置结果，Future 获取结果，二者通过一个共享状态关联，共享状态只分配一次。
+ * 在调度器的协程中等待结果时只挂起当前协程，结果就绪后协程被重新加入原调度器；
+ * 在协程之外（包括 use_caller 时构造调度器的线程与通过 Scheduler::scheduleInline 提交的任务）等待时阻塞当前线程。
+ * then 注册的后续操作保存在共享状态中，结果就绪时作为任务提交给调度器，
+ * 捕获内容不超过 InlineFunction::kInlineSize 字节时注册与提交都不需要额外分配内存。
+ * Future 只能移动，get 与 then 会消耗 Future，一个结果只能被获取一次。
+*/
+
+#include "exception.h"
+#include "fiber.h"
+#include "inline_function.h"
+#include "scheduler.h"
+#include "thread.h"
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class Future;
+template <typename T>
+class Promise;
+
+namespace FutureDetail
+{
+
+// 结果值的存储，设置之前不构造 T，因此不要求 T 可以默认构造
+template <typename T>
+struct Storage
+{
+    Storage() {}
+
+    ~Storage()
+    {
+        if (has_value)
+        {
+            value.~T();
+        }
+    }
+
+    template <typename... Args>
+    void set(Args&&... args)
+    {
+        new (&value) T(std::forward<Args>(args)...);
+        has_value = true;
+    }
+
+    T take()
+    {
+        return std::move(value);
+    }
+
+    union
+    {
+        T value;
+    };
+    bool has_value = false;
+};
+
+template <>
+struct Storage<void>
+{
+    void set() {}
+    void take() {}
+};
+
+/**
+ * @brief Promise 与 Future 的共享状态 thread-safe
+ * 只有一个消费者，因此最多只有一个等待的协程与一个后续操作
+ * */
+template <typename T>
+class State : public noncopyable
+{
+public:
+    using ptr = std::shared_ptr<State>;
+
+    bool isReady() const
+    {
+        return m_ready.load(std::memory_order_acquire);
+    }
+
+    template <typename... Args>
+    void setValue(Args&&... args)
+    {
+        ScopedLock lock(&m_mutex);
+        checkUnset();
+        m_storage.set(std::forward<Args>(args)...);
+        complete(lock);
+    }
+
+    void setException(std::exception_ptr exception)
+    {
+        ScopedLock lock(&m_mutex);
+        checkUnset();
+        m_exception = std::move(exception);
+        complete(lock);
+    }
+
+    // 标记 Future 已经被获取，返回之前是否已经获取过
+    bool retrieve()
+    {
+        ScopedLock lock(&m_mutex);
+        const bool retrieved = m_retrieved;
+        m_retrieved = true;
+        return retrieved;
+    }
+
+    // 等待结果就绪，在协程中挂起当前协程，否则阻塞当前线程
+    void wait()
+    {
+        if (isReady())
+        {
+            return;
+        }
+        ScopedLock lock(&m_mutex);
+        if (isReady())
+        {
+            return;
+        }
+        if (Fiber::InSchedulerFiber())
+        {
+            m_waiter_scheduler = Scheduler::GetThis();
+            m_waiter = Fiber::GetThis();
+            lock.unlock();
+            // 被唤醒时结果已经就绪
+            Fiber::YieldToHold();
+            return;
+        }
+        ++m_thread_waiters;
+        while (!isReady())
+        {
+            m_cond.wait(m_mutex);
+        }
+        --m_thread_waiters;
+    }
+
+    // 等待并取出结果，结果是异常时重新抛出，只能调用一次
+    T take()
+    {
+        wait();
+        if (m_exception)
+        {
+            std::rethrow_exception(m_exception);
+        }
+        return m_storage.take();
+    }
+
+    /**
+     * @brief 注册结果就绪时执行的回调，只能注册一次
+     * @param scheduler 执行回调的调度器，为空时在设置结果的线程中直接调用；
+     * 注册时结果已经就绪则立即提交或者调用
+     * */
+    void setCallback(Scheduler* scheduler, InlineFunction callback)
+    {
+        {
+            ScopedLock lock(&m_mutex);
+            if (!isReady())
+            {
+                m_callback = std::move(callback);
+                m_callback_scheduler = scheduler;
+                return;
+            }
+        }
+        Dispatch(scheduler, callback);
+    }
+
+private:
+    void checkUnset() const
+    {
+        if (isReady())
+        {
+            throw Exception("Promise 的结果已经设置");
+        }
+    }
+
+    // 标记结果就绪，释放锁之后唤醒等待者并执行回调
+    void complete(ScopedLock& lock)
+    {
+        m_ready.store(true, std::memory_order_release);
+        if (m_thread_waiters > 0)
+        {
+            m_cond.notifyAll();
+        }
+        Scheduler* waiter_scheduler = m_waiter_scheduler;
+        Fiber::ptr waiter = std::move(m_waiter);
+        Scheduler* callback_scheduler = m_callback_scheduler;
+        InlineFunction callback = std::move(m_callback);
+        lock.unlock();
+        if (waiter)
+        {
+            waiter_scheduler->schedule(std::move(waiter));
+        }
+        if (callback)
+        {
+            Dispatch(callback_scheduler, callback);
+        }
+    }
+
+    static void Dispatch(Scheduler* scheduler, InlineFunction& callback)
+    {
+        if (scheduler)
+        {
+            scheduler->schedule(std::move(callback));
+        }
+        else
+        {
+            callback();
+        }
+    }
+
+private:
+    Mutex m_mutex;
+    std::atomic<bool> m_ready{false};
+    Storage<T> m_storage;
+    std::exception_ptr m_exception;
+    // Future 是否已经被获取
+    bool m_retrieved = false;
+    // 在协程之外等待的线程数量
+    size_t m_thread_waiters = 0;
+    Condition m_cond;
+    // 挂起等待的协程及其所属的调度器
+    Scheduler* m_waiter_scheduler = nullptr;
+    Fiber::ptr m_waiter;
+    // 结果就绪时执行的回调
+    Scheduler* m_callback_scheduler = nullptr;
+    InlineFunction m_callback;
+};
+
+// 以 T 类型的结果调用 func 的返回值类型
+template <typename F, typename T>
+struct ResultOf
+{
+    using type = typename std::decay<decltype(std::declval<F&>()(std::declval<T>()))>::type;
+};
+
+template <typename F>
+struct ResultOf<F, void>
+{
+    using type = typename std::decay<decltype(std::declval<F&>()())>::type;
+};
+
+// 取出 source 的结果并调用 func
+template <typename T>
+struct Apply
+{
+    template <typename F>
+    static auto Call(F& func, State<T>& source) -> decltype(func(source.take()))
+    {
+        return func(source.take());
+    }
+};
+
+template <>
+struct Apply<void>
+{
+    template <typename F>
+    static auto Call(F& func, State<void>& source) -> decltype(func())
+    {
+        source.take();
+        return func();
+    }
+};
+
+// 调用 func 并把返回值或者抛出的异常设置到 promise，在 Promise 定义之后定义
+template <typename R>
+struct Fulfill;
+
+// 访问 Future 的共享状态，供 WhenAll、WhenAny 使用
+struct Access
+{
+    template <typename T>
+    static typename State<T>::ptr Detach(Future<T>& future)
+    {
+        return future.detach();
+    }
+};
+
+} // namespace FutureDetail
+
+/**
+ * @brief 异步结果的获取端，只能移动
+ * */
+template <typename T>
+class Future
+{
+    static_assert(!std::is_reference<T>::value, "Future 不能保存引用");
+
+public:
+    using value_type = T;
+
+    Future() = default;
+    Future(Future&&) = default;
+    Future& operator=(Future&&) = default;
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    // 是否关联了结果，get 与 then 之后不再关联
+    bool valid() const
+    {
+        return m_state != nullptr;
+    }
+
+    bool isReady() const
+    {
+        return m_state && m_state->isReady();
+    }
+
+    // 等待结果就绪，在协程中挂起当前协程，否则阻塞当前线程
+    void wait() const
+    {
+        state().wait();
+    }
+
+    /**
+     * @brief 等待并返回结果，结果是异常时重新抛出
+     * 调用之后 Future 不再关联结果
+     * */
+    T get()
+    {
+        auto state = detach();
+        return state->take();
+    }
+
+    /**
+     * @brief 注册后续操作，结果就绪后以结果调用 func(T)（T 为 void 时调用 func()）
+     * 结果是异常时不调用 func，异常传递给返回的 Future；func 抛出的异常同样传递给返回的 Future。
+     * 调用之后当前 Future 不再关联结果
+     * @param scheduler 执行 func 的调度器，为空时在设置结果的线程中直接调用
+     * @return func 返回值的 Future
+     * */
+    template <typename F>
+    Future<typename FutureDetail::ResultOf<F, T>::type> then(Scheduler* scheduler, F&& func)
+    {
+        using R = typename FutureDetail::ResultOf<F, T>::type;
+        auto state = detach();
+        FutureDetail::State<T>* source = state.get();
+        Promise<R> promise;
+        Future<R> future = promise.getFuture();
+        // 共享状态与 promise 各占 16 字节，func 的捕获不超过 16 字节时回调内联存储（InlineFunction::kInlineSize 为 48）
+        source->setCallback(scheduler, [state = std::move(state), promise = std::move(promise),
+                                        func = typename std::decay<F>::type(std::forward<F>(func))]() mutable {
+            FutureDetail::Fulfill<R>::Call(promise, [&]() {
+                return FutureDetail::Apply<T>::Call(func, *state);
+            });
+        });
+        return future;
+    }
+
+    /**
+     * @brief 注册后续操作，在当前线程的调度器上执行，当前线程不属于调度器时在设置结果的线程中直接调用
+     * */
+    template <typename F>
+    Future<typename FutureDetail::ResultOf<F, T>::type> then(F&& func)
+    {
+        return then(Scheduler::GetThis(), std::forward<F>(func));
+    }
+
+private:
+    friend class Promise<T>;
+    friend struct FutureDetail::Access;
+
+    explicit Future(typename FutureDetail::State<T>::ptr state)
+        : m_state(std::move(state)) {}
+
+    FutureDetail::State<T>& state() const
+    {
+        if (!m_state)
+        {
+            throw Exception("Future 没有关联的结果");
+        }
+        return *m_state;
+    }
+
+    typename FutureDetail::State<T>::ptr detach()
+    {
+        state();
+        return std::move(m_state);
+    }
+
+private:
+    typename FutureDetail::State<T>::ptr m_state;
+};
+
+/**
+ * @brief 异步结果的设置端，只能移动
+ * 结果只能设置一次，销毁之前没有设置结果时 Future 得到 Exception
+ * */
+template <typename T>
+class Promise
+{
+public:
+    Promise()
+        : m_state(std::make_shared<FutureDetail::State<T>>()) {}
+
+    Promise(Promise&& rhs) noexcept
+        : m_state(std::move(rhs.m_state)) {}
+
+    Promise& operator=(Promise&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            abandon();
+            m_state = std::move(rhs.m_state);
+        }
+        return *this;
+    }
+
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    ~Promise()
+    {
+        abandon();
+    }
+
+    // 获取关联的 Future，只能调用一次
+    Future<T> getFuture()
+    {
+        if (state()->retrieve())
+        {
+            throw Exception("Promise 的 Future 已经被获取");
+        }
+        return Future<T>(m_state);
+    }
+
+    /**
+     * @brief 设置结果并唤醒等待者、提交后续操作 thread-safe
+     * @param args 构造 T 的参数，T 为 void 时没有参数
+     * */
+    template <typename... Args>
+    void setValue(Args&&... args)
+    {
+        state()->setValue(std::forward<Args>(args)...);
+    }
+
+    void setException(std::exception_ptr exception)
+    {
+        state()->setException(std::move(exception));
+    }
+
+private:
+    const typename FutureDetail::State<T>::ptr& state() const
+    {
+        if (!m_state)
+        {
+            throw Exception("Promise 没有关联的状态");
+        }
+        return m_state;
+    }
+
+    void abandon()
+    {
+        if (m_state && !m_state->isReady())
+        {
+            m_state->setException(std::make_exception_ptr(Exception("Promise 在设置结果之前被销毁")));
+        }
+    }
+
+private:
+    // 只保存共享状态，与一个 shared_ptr 同样大小，then 的回调可以内联存储
+    typename FutureDetail::State<T>::ptr m_state;
+};
+
+namespace FutureDetail
+{
+
+template <typename R>
+struct Fulfill
+{
+    template <typename F>
+    static void Call(Promise<R>& promise, F&& func)
+    {
+        try
+        {
+            promise.setValue(func());
+        }
+        catch (...)
+        {
+            promise.setException(std::current_exception());
+        }
+    }
+};
+
+template <>
+struct Fulfill<void>
+{
+    template <typename F>
+    static void Call(Promise<void>& promise, F&& func)
+    {
+        try
+        {
+            func();
+            promise.setValue();
+        }
+        catch (...)
+        {
+            promise.setException(std::current_exception());
+        }
+    }
+};
+
+} // namespace FutureDetail
+
+/**
+ * @brief 返回已经就绪的 Future
+ * */
+template <typename T>
+Future<typename std::decay<T>::type> MakeReadyFuture(T&& value)
+{
+    Promise<typename std::decay<T>::type> promise;
+    promise.setValue(std::forward<T>(value));
+    return promise.getFuture();
+}
+
+inline Future<void> MakeReadyFuture()
+{
+    Promise<void> promise;
+    promise.setValue();
+    return promise.getFuture();
+}
+
+template <typename T>
+Future<T> MakeExceptionalFuture(std::exception_ptr exception)
+{
+    Promise<T> promise;
+    promise.setException(std::move(exception));
+    return promise.getFuture();
+}
+
+/**
+ * @brief 把 func 作为任务提交给调度器，返回其结果的 Future
+ * @param thread_id 任务要绑定执行线程的 id
+ * */
+template <typename F>
+Future<typename std::decay<decltype(std::declval<F&>()())>::type>
+Async(Scheduler* scheduler, F&& func, long thread_id = -1)
+{
+    using R = typename std::decay<decltype(std::declval<F&>()())>::type;
+    Promise<R> promise;
+    Future<R> future = promise.getFuture();
+    scheduler->schedule([promise = std::move(promise),
+                         func = typename std::decay<F>::type(std::forward<F>(func))]() mutable {
+        FutureDetail::Fulfill<R>::Call(promise, func);
+    },
+                        thread_id);
+    return future;
+}
+
+namespace FutureDetail
+{
+
+// WhenAll 的共享状态，按输入顺序保存结果
+template <typename T>
+struct AllContext
+{
+    using result_type = std::vector<T>;
+
+    explicit AllContext(size_t count)
+        : values(count), remaining(count) {}
+
+    void store(size_t index, State<T>& source)
+    {
+        values[index].set(source.take());
+    }
+
+    void finish()
+    {
+        result_type result;
+        result.reserve(values.size());
+        for (auto& value : values)
+        {
+            result.push_back(value.take());
+        }
+        promise.setValue(std::move(result));
+    }
+
+    std::vector<Storage<T>> values;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> done{false};
+    Promise<result_type> promise;
+};
+
+template <>
+struct AllContext<void>
+{
+    using result_type = void;
+
+    explicit AllContext(size_t count)
+        : remaining(count) {}
+
+    void store(size_t, State<void>& source)
+    {
+        source.take();
+    }
+
+    void finish()
+    {
+        promise.setValue();
+    }
+
+    std::atomic<size_t> remaining;
+    std::atomic<bool> done{false};
+    Promise<void> promise;
+};
+
+// WhenAny 的结果：就绪的 Future 的下标与结果
+template <typename T>
+struct AnyResult
+{
+    using type = std::pair<size_t, T>;
+
+    static type Make(size_t index, State<T>& source)
+    {
+        return type(index, source.take());
+    }
+};
+
+template <>
+struct AnyResult<void>
+{
+    using type = size_t;
+
+    static type Make(size_t index, State<void>& source)
+    {
+        source.take();
+        return index;
+    }
+};
+
+template <typename T>
+struct AnyContext
+{
+    std::atomic<bool> done{false};
+    Promise<typename AnyResult<T>::type> promise;
+};
+
+} // namespace FutureDetail
+
+/**
+ * @brief 所有 Future 都就绪时就绪，结果按输入顺序组成 std::vector<T>（T 为 void 时为 Future<void>）
+ * 任意一个 Future 的结果是异常时立即以该异常就绪，不再等待其他 Future。
+ * 输入的 Future 被消耗，回调在设置结果的线程中直接执行
+ * */
+template <typename InputIterator>
+Future<typename FutureDetail::AllContext<
+    typename std::iterator_traits<InputIterator>::value_type::value_type>::result_type>
+WhenAll(InputIterator begin, InputIterator end)
+{
+    using T = typename std::iterator_traits<InputIterator>::value_type::value_type;
+    using Context = FutureDetail::AllContext<T>;
+    std::vector<typename FutureDetail::State<T>::ptr> states;
+    for (; begin != end; ++begin)
+    {
+        states.push_back(FutureDetail::Access::Detach(*begin));
+    }
+    auto context = std::make_shared<Context>(states.size());
+    auto future = context->promise.getFuture();
+    if (states.empty())
+    {
+        context->finish();
+        return future;
+    }
+    for (size_t i = 0; i < states.size(); ++i)
+    {
+        FutureDetail::State<T>* source = states[i].get();
+        source->setCallback(nullptr, [context, i, state = std::move(states[i])]() {
+            try
+            {
+                context->store(i, *state);
+            }
+            catch (...)
+            {
+                if (!context->done.exchange(true, std::memory_order_acq_rel))
+                {
+                    context->promise.setException(std::current_exception());
+                }
+                return;
+            }
+            if (context->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+                !context->done.exchange(true, std::memory_order_acq_rel))
+            {
+                context->finish();
+            }
+        });
+    }
+    return future;
+}
+
+template <typename T>
+Future<typename FutureDetail::AllContext<T>::result_type> WhenAll(std::vector<Future<T>>& futures)
+{
+    return WhenAll(futures.begin(), futures.end());
+}
+
+/**
+ * @brief 第一个 Future 就绪时就绪，结果为 std::pair<下标, T>（T 为 void 时为下标）
+ * 第一个就绪的 Future 的结果是异常时以该异常就绪，其余 Future 的结果被丢弃。
+ * 输入的 Future 被消耗，输入为空时抛出 Exception
+ * */
+template <typename InputIterator>
+Future<typename FutureDetail::AnyResult<
+    typename std::iterator_traits<InputIterator>::value_type::value_type>::type>
+WhenAny(InputIterator begin, InputIterator end)
+{
+    using T = typename std::iterator_traits<InputIterator>::value_type::value_type;
+    using Result = FutureDetail::AnyResult<T>;
+    if (begin == end)
+    {
+        throw Exception("WhenAny 的输入为空");
+    }
+    auto context = std::make_shared<FutureDetail::AnyContext<T>>();
+    auto future = context->promise.getFuture();
+    for (size_t i = 0; begin != end; ++begin, ++i)
+    {
+        auto state = FutureDetail::Access::Detach(*begin);
+        FutureDetail::State<T>* source = state.get();
+        source->setCallback(nullptr, [context, i, state = std::move(state)]() {
+            if (!context->done.exchange(true, std::memory_order_acq_rel))
+            {
+                FutureDetail::Fulfill<typename Result::type>::Call(context->promise, [&]() {
+                    return Result::Make(i, *state);
+                });
+            }
+        });
+    }
+    return future;
+}
+
+template <typename T>
+Future<typename FutureDetail::AnyResult<T>::type> WhenAny(std::vector<Future<T>>& futures)
+{
+    return WhenAny(futures.begin(), futures.end());
+}
+
+#endif // __FUTURE_H__
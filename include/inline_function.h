@@ -0,0 +1,203 @@
+#ifndef __INLINE_FUNCTION_H__
+#define __INLINE_FUNCTION_H__
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+/**
+ * @brief 只能移动的 void() 可调用对象包装
+ * 与 std::function 相比，不要求可调用对象可以复制，并且内联存储不超过 kInlineSize 字节的可调用对象
+ * （std::function 只内联存储很小的可平凡复制对象），捕获了智能指针或几个变量的 lambda 不需要分配堆内存。
+ * 超过内联容量的可调用对象仍然分配在堆上。
+*/
+class InlineFunction
+{
+public:
+    static constexpr size_t kInlineSize = 48;
+
+    InlineFunction() = default;
+
+    InlineFunction(std::nullptr_t) {}
+
+    template <typename F,
+              typename = typename std::enable_if<
+                  !std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction(F&& func)
+    {
+        assign(std::forward<F>(func));
+    }
+
+    InlineFunction(InlineFunction&& rhs) noexcept
+    {
+        moveFrom(rhs);
+    }
+
+    InlineFunction& operator=(InlineFunction&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            reset();
+            moveFrom(rhs);
+        }
+        return *this;
+    }
+
+    InlineFunction& operator=(std::nullptr_t)
+    {
+        reset();
+        return *this;
+    }
+
+    template <typename F,
+              typename = typename std::enable_if<
+                  !std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction& operator=(F&& func)
+    {
+        reset();
+        assign(std::forward<F>(func));
+        return *this;
+    }
+
+    InlineFunction(const InlineFunction&) = delete;
+    InlineFunction& operator=(const InlineFunction&) = delete;
+
+    ~InlineFunction()
+    {
+        reset();
+    }
+
+    void operator()()
+    {
+        m_ops->invoke(m_storage);
+    }
+
+    explicit operator bool() const noexcept { return m_ops != nullptr; }
+
+    // 被包装的可调用对象的类型，为空时返回 typeid(void)
+    const std::type_info& target_type() const noexcept
+    {
+        return m_ops ? *m_ops->type : typeid(void);
+    }
+
+    void reset() noexcept
+    {
+        if (m_ops)
+        {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    struct Ops
+    {
+        void (*invoke)(void* storage);
+        // 将 src 中的对象移动到未初始化的 dst，并销毁 src 中的对象
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* storage);
+        const std::type_info* type;
+    };
+
+    // 内联存储在 m_storage 中的可调用对象
+    template <typename F>
+    struct InlineOps
+    {
+        static void Invoke(void* storage) { (*static_cast<F*>(storage))(); }
+
+        static void Move(void* dst, void* src)
+        {
+            ::new (dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
+        }
+
+        static void Destroy(void* storage) { static_cast<F*>(storage)->~F(); }
+
+        static const Ops* Get()
+        {
+            static const Ops ops = {&Invoke, &Move, &Destroy, &typeid(F)};
+            return &ops;
+        }
+    };
+
+    // 分配在堆上的可调用对象，m_storage 中保存指针
+    template <typename F>
+    struct HeapOps
+    {
+        static F*& Ptr(void* storage) { return *static_cast<F**>(storage); }
+
+        static void Invoke(void* storage) { (*Ptr(storage))(); }
+
+        static void Move(void* dst, void* src)
+        {
+            ::new (dst) F*(Ptr(src));
+        }
+
+        static void Destroy(void* storage) { delete Ptr(storage); }
+
+        static const Ops* Get()
+        {
+            static const Ops ops = {&Invoke, &Move, &Destroy, &typeid(F)};
+            return &ops;
+        }
+    };
+
+    template <typename F>
+    static bool IsNull(const F&) { return false; }
+
+    template <typename F>
+    static bool IsNull(F* func) { return func == nullptr; }
+
+    template <typename R, typename... Args>
+    static bool IsNull(const std::function<R(Args...)>& func) { return !func; }
+
+    // 可以内联存储的可调用对象：大小、对齐满足要求，并且移动时不抛出异常
+    template <typename Functor>
+    using FitsInline = std::integral_constant<
+        bool, sizeof(Functor) <= kInlineSize && alignof(Functor) <= alignof(std::max_align_t) &&
+                  std::is_nothrow_move_constructible<Functor>::value>;
+
+    template <typename F>
+    void assign(F&& func)
+    {
+        using Functor = typename std::decay<F>::type;
+        if (IsNull(func))
+        {
+            return;
+        }
+        construct<Functor>(std::forward<F>(func), FitsInline<Functor>());
+    }
+
+    template <typename Functor, typename F>
+    void construct(F&& func, std::true_type)
+    {
+        ::new (static_cast<void*>(m_storage)) Functor(std::forward<F>(func));
+        m_ops = InlineOps<Functor>::Get();
+    }
+
+    template <typename Functor, typename F>
+    void construct(F&& func, std::false_type)
+    {
+        ::new (static_cast<void*>(m_storage)) Functor*(new Functor(std::forward<F>(func)));
+        m_ops = HeapOps<Functor>::Get();
+    }
+
+    void moveFrom(InlineFunction& rhs) noexcept
+    {
+        if (rhs.m_ops)
+        {
+            rhs.m_ops->move(m_storage, rhs.m_storage);
+            m_ops = rhs.m_ops;
+            rhs.m_ops = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char m_storage[kInlineSize];
+    const Ops* m_ops = nullptr;
+};
+
+#endif // __INLINE_FUNCTION_H__
@@ -0,0 +1,78 @@
+#ifndef __MPSC_QUEUE_H__
+#define __MPSC_QUEUE_H__
+
+#include "noncopyable.h"
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @brief 侵入式多生产者单消费者队列
+ * 生产者通过 CAS 把节点压入无锁栈，消费者一次取走整个栈并反转成先进先出的私有链表，
+ * 之后从私有链表中依次取出，入队与出队的均摊复杂度都是 O(1)。
+ * 同一个生产者加入的节点按加入顺序出队。
+ * @tparam T 节点类型，必须有 T* next 成员，节点在队列中时 next 归队列使用
+*/
+template <typename T>
+class MpscQueue : public noncopyable
+{
+public:
+    MpscQueue() = default;
+
+    /**
+     * @brief 加入节点 thread-safe
+     * */
+    void push(T* node)
+    {
+        // 先增加计数，保证消费者取到节点时计数不会小于 0
+        m_size.fetch_add(1);
+        T* head = m_head.load(std::memory_order_relaxed);
+        do
+        {
+            node->next = head;
+        } while (!m_head.compare_exchange_weak(head, node, std::memory_order_release,
+                                               std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief 取出最早加入的节点，只能由消费者线程调用
+     * @return 队列为空时返回 nullptr
+     * */
+    T* pop()
+    {
+        if (m_pending == nullptr)
+        {
+            T* head = m_head.exchange(nullptr, std::memory_order_acquire);
+            // 栈中的节点是后进先出的，反转成先进先出
+            while (head)
+            {
+                T* next = head->next;
+                head->next = m_pending;
+                m_pending = head;
+                head = next;
+            }
+            if (m_pending == nullptr)
+            {
+                return nullptr;
+            }
+        }
+        T* node = m_pending;
+        m_pending = node->next;
+        node->next = nullptr;
+        m_size.fetch_sub(1);
+        return node;
+    }
+
+    // 近似的节点数量，其他线程读取时可能已经过时
+    size_t size() const { return m_size.load(); }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    // 生产者压入节点的无锁栈
+    std::atomic<T*> m_head{nullptr};
+    // 消费者私有的先进先出链表
+    T* m_pending = nullptr;
+    std::atomic<size_t> m_size{0};
+};
+
+#endif // __MPSC_QUEUE_H__
@@ -0,0 +1,296 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+/**
+ * 基于 Scheduler 的 fork-join 并行算法
+ * 区间被动态地切分成块：参与者（调用者与调度器上的辅助任务）通过原子游标领取块，
+ * 块的大小取剩余元素数除以参与者数量的一半（不小于粒度），开始时块大、接近结束时块小，
+ * 在负载不均衡时自动调整（guided self-scheduling）。
+ * 调用者自己也执行块，而不是阻塞等待：全部块领取完之后，在协程中调用时挂起当前协程等待
+ * 其他参与者手中的块完成，在协程之外调用时阻塞当前线程。
+ * 已经领取完所有块时才开始运行的辅助任务直接返回，调用者不等待它们。
+*/
+
+#include "fiber.h"
+#include "fiber_sync.h"
+#include "scheduler.h"
+#include "thread.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace ParallelDetail
+{
+
+// 自动粒度时每个参与者平均分到的最少块数
+static constexpr size_t kChunksPerWorker = 64;
+
+// 一次并行执行的共享状态，由调用者与辅助任务共同持有
+template <typename Body>
+struct State
+{
+    State(size_t count, size_t grain, size_t workers, Body* body, bool in_fiber)
+        : next(0), end(count), grain(grain), workers(workers), remaining(count),
+          body(body), in_fiber(in_fiber) {}
+
+    // 领取一块 [begin, end)，没有剩余时返回 false
+    bool claim(size_t& begin, size_t& finish)
+    {
+        begin = next.load(std::memory_order_relaxed);
+        while (begin < end)
+        {
+            size_t length = std::max(grain, (end - begin) / (2 * workers));
+            length = std::min(length, end - begin);
+            if (next.compare_exchange_weak(begin, begin + length, std::memory_order_relaxed))
+            {
+                finish = begin + length;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 领取并执行块，直到没有剩余；返回是否由自己完成了最后一块
+    bool drain()
+    {
+        bool last = false;
+        size_t begin = 0;
+        size_t finish = 0;
+        while (claim(begin, finish))
+        {
+            if (!failed.load(std::memory_order_relaxed))
+            {
+                try
+                {
+                    (*body)(begin, finish);
+                }
+                catch (...)
+                {
+                    // 记录第一个异常，之后领取的块不再执行
+                    ScopedLock lock(&mutex);
+                    if (!exception)
+                    {
+                        exception = std::current_exception();
+                    }
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+            const size_t length = finish - begin;
+            last = (remaining.fetch_sub(length, std::memory_order_acq_rel) == length) || last;
+        }
+        return last;
+    }
+
+    // 完成最后一块的辅助任务通知调用者
+    void notify()
+    {
+        if (in_fiber)
+        {
+            fiber_done.notify();
+        }
+        else
+        {
+            thread_done.notify();
+        }
+    }
+
+    void wait()
+    {
+        if (in_fiber)
+        {
+            fiber_done.wait();
+        }
+        else
+        {
+            thread_done.wait();
+        }
+    }
+
+    std::atomic<size_t> next;
+    const size_t end;
+    const size_t grain;
+    const size_t workers;
+    // 还没有执行完的元素数量
+    std::atomic<size_t> remaining;
+    Body* body;
+    const bool in_fiber;
+    std::atomic<bool> failed{false};
+    Mutex mutex;
+    std::exception_ptr exception;
+    FiberSemaphore fiber_done{0};
+    Semaphore thread_done{0};
+};
+
+/**
+ * @brief 在调度器上并行执行 body(begin, end)，覆盖 [0, count) 的所有元素
+ * @param grain 块的最小元素数，0 表示根据元素数量与线程数量自动选择
+ * */
+template <typename Body>
+void Run(Scheduler* scheduler, size_t count, size_t grain, Body& body)
+{
+    assert(scheduler);
+    if (count == 0)
+    {
+        return;
+    }
+    const size_t threads = std::max<size_t>(scheduler->threadCount(), 1);
+    if (grain == 0)
+    {
+        grain = std::max<size_t>(1, count / (threads * kChunksPerWorker));
+    }
+    if (count <= grain || threads == 1)
+    {
+        body(0, count);
+        return;
+    }
+    // 只有调度器的协程可以挂起等待，其他调用者（包括 use_caller 时构造调度器的线程）阻塞在信号量上
+    const bool in_fiber = Fiber::InSchedulerFiber();
+    // 调用者正在本调度器的工作线程上调度时自己占用一个线程，否则所有线程都可以运行辅助任务。
+    // use_caller 的线程在 stop() 之前不参与调度
+    const bool on_scheduler = (Scheduler::GetThis() == scheduler) &&
+                              (in_fiber || FiberInfo::t_fiber == Scheduler::GetMainFiber());
+    const size_t helpers = std::min(on_scheduler ? threads - 1 : threads, (count - 1) / grain);
+    auto state = std::make_shared<State<Body>>(count, grain, helpers + 1, &body, in_fiber);
+    for (size_t i = 0; i < helpers; ++i)
+    {
+        scheduler->schedule([state]() {
+            if (state->drain())
+            {
+                state->notify();
+            }
+        });
+    }
+    if (!state->drain())
+    {
+        state->wait();
+    }
+    if (state->exception)
+    {
+        std::rethrow_exception(state->exception);
+    }
+}
+
+} // namespace ParallelDetail
+
+/**
+ * @brief 并行执行 body(i)，i 取遍 [begin, end)
+ * @param scheduler 执行辅助任务的调度器
+ * @param body 每个元素调用一次，可能在多个线程上并发调用
+ * @param grain 块的最小元素数，0 表示自动选择
+ * body 抛出的第一个异常在所有已领取的块结束后重新抛出，其余未开始的块不再执行
+ * */
+template <typename Index, typename Body>
+void ParallelFor(Scheduler* scheduler, Index begin, Index end, Body&& body, size_t grain = 0)
+{
+    if (!(begin < end))
+    {
+        return;
+    }
+    auto range = [begin, &body](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            body(static_cast<Index>(begin + i));
+        }
+    };
+    ParallelDetail::Run(scheduler, static_cast<size_t>(end - begin), grain, range);
+}
+
+/**
+ * @brief 并行归约：返回 identity 与所有 map(i) 按 combine 合并的结果，i 取遍 [begin, end)
+ * 每块先在本地归约，再合并到总结果，combine 需要满足结合律与交换律（块的合并顺序不确定）
+ * @param identity combine 的单位元
+ * @param map 每个元素调用一次，返回 T
+ * @param combine (T, T) -> T
+ * */
+template <typename Index, typename T, typename Map, typename Combine>
+T ParallelReduce(Scheduler* scheduler, Index begin, Index end, T identity, Map&& map,
+                 Combine&& combine, size_t grain = 0)
+{
+    if (!(begin < end))
+    {
+        return identity;
+    }
+    T result = identity;
+    Mutex mutex;
+    auto range = [&](size_t first, size_t last) {
+        T partial = identity;
+        for (size_t i = first; i < last; ++i)
+        {
+            partial = combine(std::move(partial), map(static_cast<Index>(begin + i)));
+        }
+        ScopedLock lock(&mutex);
+        result = combine(std::move(result), std::move(partial));
+    };
+    ParallelDetail::Run(scheduler, static_cast<size_t>(end - begin), grain, range);
+    return result;
+}
+
+/**
+ * @brief 并行排序 [first, last)，不稳定
+ * 先把区间分成 2 的幂个段并行排序，再逐轮并行地两两归并相邻的段
+ * @param grain 小于该长度的区间直接调用 std::sort，0 表示使用默认值
+ * */
+template <typename RandomIt, typename Compare>
+void ParallelSort(Scheduler* scheduler, RandomIt first, RandomIt last, Compare comp,
+                  size_t grain = 0)
+{
+    const size_t count = static_cast<size_t>(std::distance(first, last));
+    const size_t threads = std::max<size_t>(scheduler->threadCount(), 1);
+    grain = grain ? grain : 4096;
+    if (count <= grain || threads == 1)
+    {
+        std::sort(first, last, comp);
+        return;
+    }
+    // 段的数量：不少于线程数量的 2 的幂，并且每段不小于粒度
+    size_t segments = 1;
+    while (segments < threads * 2 && count / (segments * 2) >= grain)
+    {
+        segments *= 2;
+    }
+    auto bound = [first, count, segments](size_t index) {
+        return first + static_cast<std::ptrdiff_t>(count * index / segments);
+    };
+    ParallelFor(scheduler, size_t(0), segments,
+                [&](size_t i) { std::sort(bound(i), bound(i + 1), comp); }, 1);
+    for (size_t width = 1; width < segments; width *= 2)
+    {
+        ParallelFor(scheduler, size_t(0), segments / (width * 2),
+                    [&](size_t i) {
+                        const size_t lo = i * width * 2;
+                        std::inplace_merge(bound(lo), bound(lo + width), bound(lo + width * 2), comp);
+                    },
+                    1);
+    }
+}
+
+template <typename RandomIt>
+void ParallelSort(Scheduler* scheduler, RandomIt first, RandomIt last, size_t grain = 0)
+{
+    ParallelSort(scheduler, first, last,
+                 std::less<typename std::iterator_traits<RandomIt>::value_type>(), grain);
+}
+
+/**
+ * @brief 并行调用所有可调用对象，全部结束后返回
+ * */
+template <typename... Funcs>
+void ParallelInvoke(Scheduler* scheduler, Funcs&&... funcs)
+{
+    std::function<void()> tasks[] = {std::function<void()>(std::ref(funcs))...};
+    auto range = [&tasks](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            tasks[i]();
+        }
+    };
+    ParallelDetail::Run(scheduler, sizeof...(Funcs), 1, range);
+}
+
+#endif // __PARALLEL_H__
@@ -0,0 +1,162 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "thread.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 按 2 的幂次分桶的直方图
+ * 第 i 个桶统计落在 [2^(i-1), 2^i) 区间的样本，第 0 个桶统计值为 0 的样本
+*/
+class Log2Histogram
+{
+public:
+    static constexpr size_t kBucketCount = 64;
+
+    // 添加一个样本
+    void add(uint64_t value);
+    // 合并另一个直方图
+    void merge(const Log2Histogram& rhs);
+
+    uint64_t count() const { return m_count; }
+    uint64_t sum() const { return m_sum; }
+    uint64_t max() const { return m_max; }
+    uint64_t bucket(size_t index) const { return m_buckets[index]; }
+    // 估算第 percent 百分位的值（取所在桶的上界）
+    uint64_t percentile(double percent) const;
+
+    /**
+     * @brief 以文本形式输出非空的桶
+     * @param unit 样本的单位，仅用于显示
+     * */
+    std::string toString(const char* unit) const;
+
+private:
+    friend class AtomicLog2Histogram;
+
+    std::array<uint64_t, kBucketCount> m_buckets{};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_max = 0;
+};
+
+/**
+ * @brief 可以不加锁并发添加样本的 Log2Histogram
+ * 各字段分别原子更新，读取的快照与并发的添加之间可能不完全一致
+*/
+class AtomicLog2Histogram
+{
+public:
+    // 添加一个样本 thread-safe
+    void add(uint64_t value);
+    // 将当前数据合并到 out
+    void mergeInto(Log2Histogram& out) const;
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+
+private:
+    std::array<std::atomic<uint64_t>, Log2Histogram::kBucketCount> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+// 获取类型的可读名称，用于标识协程的入口函数
+std::string DemangleTypeName(const std::type_info& type);
+std::string DemangleTypeName(const char* mangled);
+
+/**
+ * @brief 协程栈使用量（高水位）统计
+ * 开启 "fiber.stack_profile" 后，新协程栈会被填充为固定的字节模式，
+ * 协程结束时从栈底向上扫描第一个被改写的位置，得到栈的最大使用量，并按入口函数汇总到直方图中
+*/
+class StackProfiler
+{
+public:
+    // 用填充模式覆盖栈空间 [stack, stack + size)
+    static void Fill(void* stack, size_t size);
+    // 扫描栈空间，返回栈的最大使用量（字节）
+    static size_t Scan(const void* stack, size_t size);
+    // 记录一次协程栈使用量
+    static void Record(const std::type_info& entry, size_t stack_size, size_t used);
+    // 输出所有入口函数的栈使用量统计
+    static std::string Report();
+    // 清空统计数据
+    static void Clear();
+
+private:
+    struct Entry
+    {
+        // 协程栈大小
+        size_t stack_size = 0;
+        Log2Histogram histogram;
+    };
+
+    static Mutex& GetMutex();
+    static std::map<std::string, Entry>& GetEntries();
+};
+
+/**
+ * @brief 协程运行时间与调度延迟统计
+ * 编译时定义 FIBER_ACCOUNTING 开启（见 CMakeLists.txt 中的 ENABLE_FIBER_ACCOUNTING 选项），
+ * 未开启时 Fiber 与 Scheduler 中不会生成任何统计代码。
+ * 统计数据按入口函数汇总：
+ *   run_ns   每个协程从创建到结束累计在线程上运行的时间（换入到换出的时间）
+ *   switches 每个协程被换入的次数
+ *   wait_ns  任务从加入调度器任务队列到被工作线程取出的等待时间
+*/
+class FiberAccounting
+{
+public:
+    struct Stats
+    {
+        Log2Histogram run_ns;
+        Log2Histogram switches;
+        Log2Histogram wait_ns;
+    };
+
+    // 单调时钟的当前时间（纳秒）
+    static uint64_t Now()
+    {
+        timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    // 协程结束时记录其累计运行时间与换入次数
+    static void RecordFiber(const std::type_info& entry, uint64_t run_ns, uint64_t switches);
+    // 任务被工作线程取出时记录其在任务队列中的等待时间
+    static void RecordWait(const std::type_info& entry, uint64_t wait_ns);
+    // 汇总所有线程的统计数据，键为入口函数名称
+    static std::map<std::string, Stats> Snapshot();
+    // 以文本形式输出统计数据
+    static std::string Report();
+    // 清空统计数据
+    static void Clear();
+
+private:
+    // 每个线程一份统计数据，记录时只锁本线程的数据，减少线程间竞争
+    struct Shard
+    {
+        Mutex mutex;
+        std::unordered_map<std::type_index, Stats> stats;
+    };
+
+    static Shard& GetShard();
+    static Mutex& GetMutex();
+    static std::vector<std::shared_ptr<Shard>>& GetShards();
+};
+
+#endif // __PROFILER_H__
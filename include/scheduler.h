@@ -2,60 +2,176 @@
 #define __SCHEDULER_H__
 
 #include "fiber.h"
+#include "inline_function.h"
+#include "mpsc_queue.h"
+#include "profiler.h"
 #include "thread.h"
+#include "work_steal_deque.h"
 #include <atomic>
-#include <list>
 #include <memory>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
 #include <unistd.h>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+namespace SchedulerInfo
+{
+// 是否启用工作窃取模式：每个工作线程拥有自己的任务队列，空闲时从其他线程窃取任务，
+// 在调度器构造时读取
+static ConfigVar<bool>::ptr g_work_stealing =
+    Config::Lookup<bool>("scheduler.work_stealing", false);
+// 高优先级任务连续执行多少个之后，让等待中的低优先级任务执行一个，避免低优先级任务饥饿
+static ConfigVar<uint64_t>::ptr g_starvation_limit =
+    Config::Lookup<uint64_t>("scheduler.starvation_limit", 16);
+// 空闲的工作线程休眠之前自旋检查新任务的次数
+static ConfigVar<uint64_t>::ptr g_idle_spin =
+    Config::Lookup<uint64_t>("scheduler.idle_spin", 64);
+// 是否统计任务的排队等待时间与工作线程的忙闲时间（每个任务读取两次时钟），
+// 任务数量、休眠与唤醒次数总是统计，在调度器构造时读取
+static ConfigVar<bool>::ptr g_metrics =
+    Config::Lookup<bool>("scheduler.metrics", true);
+// 任务单次连续运行（两次让出执行权之间）超过该时间（毫秒）时由监控线程报告，
+// 0 表示关闭 watchdog 检查，在调度器构造时读取
+static ConfigVar<uint64_t>::ptr g_watchdog_budget_ms =
+    Config::Lookup<uint64_t>("scheduler.watchdog.budget_ms", 500);
+// 协程连续运行超过该时间（毫秒）后，下一次调用 Fiber::MaybeYield 时让出执行权，在调度器构造时读取
+static ConfigVar<uint64_t>::ptr g_time_slice_ms =
+    Config::Lookup<uint64_t>("scheduler.watchdog.time_slice_ms", 10);
+// 监控线程（watchdog 检查与弹性调整）采样各工作线程的间隔（毫秒），在调度器构造时读取
+static ConfigVar<uint64_t>::ptr g_watchdog_interval_ms =
+    Config::Lookup<uint64_t>("scheduler.watchdog.interval_ms", 5);
+// 弹性模式：采样窗口内任务的平均排队等待时间（微秒）连续两次超过该值，并且没有空闲线程时增加一个工作线程
+static ConfigVar<uint64_t>::ptr g_elastic_grow_wait_us =
+    Config::Lookup<uint64_t>("scheduler.elastic.grow_wait_us", 1000);
+// 弹性模式：工作线程连续空闲超过该时间（毫秒），并且距离上一次增加线程也超过该时间时退出
+static ConfigVar<uint64_t>::ptr g_elastic_retire_idle_ms =
+    Config::Lookup<uint64_t>("scheduler.elastic.retire_idle_ms", 10000);
+} // namespace SchedulerInfo
+
 /**
  * @brief 协程调度器
+ * 默认所有任务保存在一个由互斥量保护的全局队列中。
+ * 工作窃取模式下，工作线程上产生的任务加入该线程的 Chase-Lev 队列，由本线程优先执行，
+ * 空闲的工作线程从随机选择的其他线程窃取任务；外部线程提交的任务仍然进入全局队列（注入队列）。
+ * 绑定线程的任务直接加入目标线程的收件箱（多生产者单消费者队列），只由该线程取出，
+ * 取任务时不需要跳过其他线程的任务；目标线程尚未开始调度时退回全局队列。
+ * 全局队列按优先级分为多个队列，高优先级先执行；每个优先级中设置了截止时间的任务按截止时间
+ * 从早到晚（EDF）先于其他任务执行；低优先级任务被连续跳过 "scheduler.starvation_limit" 次后优先执行一个。
+ * 协程不让出执行权时会一直占用工作线程：监控线程定期采样各工作线程正在执行的任务，
+ * 超过时间片时请求抢占（由 Fiber::MaybeYield 在安全点让出），超过预算时按入口函数记录并报告。
+ * 弹性模式下工作线程数量在 [min_threads, max_threads] 之间变化：监控线程发现任务排队等待时间持续过长时
+ * 增加线程，长时间空闲的线程自行退出；刚增加过线程时不退出，避免线程数量来回抖动。
  * */
 class Scheduler : public noncopyable
 {
+public: // 优先级
+    /**
+     * @brief 任务优先级
+     * 非 NORMAL 优先级或者设置了截止时间的任务总是进入全局队列
+     * */
+    enum Priority
+    {
+        HIGH = 0,
+        NORMAL = 1,
+        LOW = 2,
+    };
+    static constexpr size_t kPriorityCount = 3;
+
 private: // 内部类
     /**
      * @brief 任务类
-     * 等待分配线程执行的任务，可以是 zjl::Fiber 或 std::function
+     * 等待分配线程执行的任务，可以是 zjl::Fiber 或可调用对象。
+     * 节点通过 Create/Destroy 在线程局部的节点池中分配与回收，next 把节点串成侵入式队列，
+     * 可调用对象内联存储在节点中，稳定状态下提交任务不分配堆内存
      * */
-    struct Task
+    struct Task : public noncopyable
     {
-        using ptr = std::shared_ptr<Task>;
-        using uptr = std::unique_ptr<Task>;
-        using TaskFunc = std::function<void()>;
+        using TaskFunc = InlineFunction;
 
         Fiber::ptr fiber;
         TaskFunc callback;
-        long thread_id; // 任务要绑定执行线程的 id
-
-        Task()
-            : thread_id(-1) {}
+        long thread_id = -1; // 任务要绑定执行线程的 id
+        Priority priority = NORMAL;
+        uint64_t deadline_ns = 0; // 截止时间（CLOCK_MONOTONIC 纳秒），0 表示没有截止时间
+        bool run_inline = false; // 可调用对象不会让出执行权，直接在调度协程上执行
+        Task* next = nullptr; // 队列或节点池中的下一个节点
+        uint64_t enqueue_ns = 0; // 加入任务队列的时间戳，不统计等待时间时为 0
 
-        Task(const Task& rhs) = default;
+        // 从节点池中取出节点并设置任务内容
+        template <typename Executable>
+        static Task* Create(Executable&& exec, long tid)
+        {
+            Task* task = Alloc();
+            task->assign(std::forward<Executable>(exec));
+            task->thread_id = tid;
+            return task;
+        }
 
-        Task(Fiber::ptr f, long tid)
-            : fiber(std::move(f)), thread_id(tid) {}
+        // 清空任务内容并归还节点池
+        static void Destroy(Task* task);
 
-        Task(const TaskFunc& cb, long tid)
-            : callback(cb), thread_id(tid) {}
+    private:
+        // 节点池
+        struct Cache;
 
-        Task(TaskFunc&& cb, long tid)
-            : callback(std::move(cb)), thread_id(tid) {}
+        static Task* Alloc();
 
-        Task& operator=(const Task& rhs) = default;
+        void assign(Fiber::ptr f) { fiber = std::move(f); }
 
-        void reset()
-        {
-            fiber = nullptr;
-            callback = nullptr;
-            thread_id = -1;
-        }
+        template <typename Callable>
+        void assign(Callable&& cb) { callback = std::forward<Callable>(cb); }
     };
 
 public: // 内部类型、静态方法、友元声明
     friend class Fiber;
+
+    /**
+     * @brief 调度器运行指标的快照，由 getMetrics 生成
+     * 计数从调度器构造开始累计，采集方对相邻两次快照求差得到速率
+     * */
+    struct Metrics
+    {
+        /**
+         * @brief 一个工作线程的指标
+         * */
+        struct WorkerMetrics
+        {
+            long thread_id = -1;    // 使用该队列的线程 id，-1 表示没有线程在调度
+            uint64_t submitted = 0; // 本线程提交的任务数
+            uint64_t executed = 0;  // 本线程执行的任务数
+            uint64_t parks = 0;     // 本线程休眠的次数
+            uint64_t unparks = 0;   // 本线程唤醒其他线程的次数
+            uint64_t busy_ns = 0;   // 执行任务的时间
+            uint64_t idle_ns = 0;   // 空闲（自旋与休眠）的时间
+            size_t queue_depth = 0; // 本地队列与收件箱中的任务数
+        };
+
+        uint64_t submitted = 0; // 提交的任务数，包括外部线程提交的任务
+        uint64_t executed = 0;
+        uint64_t parks = 0;
+        uint64_t unparks = 0;
+        size_t queue_depth = 0;        // 所有队列中等待执行的任务数
+        size_t global_queue_depth = 0; // 全局队列中等待执行的任务数
+        size_t threads = 0;            // 正在调度的线程数
+        size_t active_threads = 0;
+        size_t idle_threads = 0;
+        Log2Histogram wait_ns; // 任务从加入队列到被取出的等待时间（纳秒）
+        std::vector<WorkerMetrics> workers;
+    };
+
+    /**
+     * @brief 一个入口函数超过运行预算的记录，由 getLongRuns 生成
+     * */
+    struct LongRun
+    {
+        std::string entry;      // 入口函数的类型名称
+        uint64_t count = 0;     // 超过预算的次数
+        uint64_t max_ns = 0;    // 采样到的最长连续运行时间
+        uint64_t fiber_id = 0;  // 最近一次超过预算的协程 id，0 表示调度协程上执行的任务
+    };
     using ptr = std::shared_ptr<Scheduler>;
     using uptr = std::unique_ptr<Scheduler>;
 
@@ -72,6 +188,14 @@ public: // 实例方法
      * @param name 调度器名称
      * */
     explicit Scheduler(size_t thread_size, bool use_caller = true, std::string name = "");
+    /**
+     * @brief 构造弹性调度器，min_threads 小于 max_threads 时开启弹性模式
+     * @param min_threads 最少的线程数量，启动时创建
+     * @param max_threads 最多的线程数量
+     * @param use_caller 是否将 Scheduler 实例化所在的线程作为 master fiber，该线程计入线程数量并且不会退出
+     * @param name 调度器名称
+     * */
+    Scheduler(size_t min_threads, size_t max_threads, bool use_caller, std::string name);
     virtual ~Scheduler();
 
     void start();
@@ -81,26 +205,93 @@ public: // 实例方法
     {
         return m_idle_thread_count > 0;
     }
+    // 参与调度的线程数量上限（包括 use_caller 时的当前线程），弹性模式下为 max_threads
+    size_t threadCount() const
+    {
+        return m_workers.size();
+    }
+
+    /**
+     * @brief 获取运行指标的快照 thread-safe
+     * 只读取各工作线程的原子计数，不加锁，不影响任务调度，可以定期采集
+     * */
+    Metrics getMetrics() const;
+
+    /**
+     * @brief 获取连续运行超过 "scheduler.watchdog.budget_ms" 的任务记录 thread-safe
+     * 按超过预算的次数从多到少排列，没有启动 watchdog 时为空
+     * */
+    std::vector<LongRun> getLongRuns() const;
 
     /**
      * @brief 添加任务 thread-safe
-     * @param Executable 模板类型必须是 std::unique_ptr<zjl::Fiber> 或者 std::function
+     * @param Executable 模板类型必须是 Fiber::ptr 或者可调用对象
      * @param exec Executable 的实例
-     * @param instant 是否优先调度
+     * @param instant 是否优先调度，对加入线程收件箱的任务无效
      * @param thread_id 任务要绑定执行线程的 id
      * */
     template <typename Executable>
     void schedule(Executable&& exec, long thread_id = -1, bool instant = false)
     {
-        bool need_tickle = false;
+        submit(Task::Create(std::forward<Executable>(exec), thread_id), instant);
+    }
+
+    /**
+     * @brief 添加执行到结束、不会让出执行权的可调用对象 thread-safe
+     * 任务直接在工作线程的调度协程上调用，不需要获取协程、切换上下文，适合大量很短的回调。
+     * 任务中不能让出执行权（包括通过 FiberMutex 等同步原语挂起），否则抛出 Exception，
+     * 同步原语在登记等待者之前抛出，自身状态不受影响；可能让出执行权的任务使用 schedule 提交。
+     * 任务可以使用 FiberLocal，写入的值在任务结束时销毁
+     * @param cb 可调用对象
+     * @param thread_id 任务要绑定执行线程的 id
+     * */
+    template <typename Callable>
+    void scheduleInline(Callable&& cb, long thread_id = -1)
+    {
+        Task* task = Task::Create(std::forward<Callable>(cb), thread_id);
+        task->run_inline = true;
+        submit(task, false);
+    }
+
+    /**
+     * @brief 按优先级添加任务 thread-safe
+     * @param exec Executable 的实例
+     * @param priority 任务优先级
+     * @param deadline_ms 相对当前时间的截止时间（毫秒），同一优先级中按截止时间从早到晚执行，0 表示没有截止时间
+     * @param thread_id 任务要绑定执行线程的 id
+     * */
+    template <typename Executable>
+    void schedule(Executable&& exec, Priority priority, uint64_t deadline_ms = 0, long thread_id = -1)
+    {
+        if (priority == NORMAL && deadline_ms == 0)
+        {
+            schedule(std::forward<Executable>(exec), thread_id);
+            return;
+        }
+        Task* task = Task::Create(std::forward<Executable>(exec), thread_id);
+        task->priority = priority;
+        if (deadline_ms != 0)
+        {
+            task->deadline_ns = DeadlineFromNow(deadline_ms);
+        }
+        if (!task->fiber && !task->callback)
+        {
+            Task::Destroy(task);
+            return;
+        }
         {
             ScopedLock lock(&m_mutex);
-            // std::forward
-            need_tickle = scheduleNonBlock(std::forward<Executable>(exec), thread_id);
+            onEnqueue(task);
+            pushGlobalTask(task, false);
         }
-        // 该工作了
-        if (need_tickle)
+        if (thread_id == -1)
+        {
             tickle();
+        }
+        else
+        {
+            unpark(thread_id, false);
+        }
     }
 
     /**
@@ -111,16 +302,18 @@ public: // 实例方法
     template <typename InputIterator>
     void schedule(InputIterator begin, InputIterator end)
     {
-        bool need_tickle = false;
+        size_t count = 0;
         {
             ScopedLock lock(&m_mutex);
             while (begin != end)
             {
-                need_tickle = scheduleNonBlock(*begin) || need_tickle;
+                scheduleNonBlock(*begin);
                 ++begin;
+                ++count;
             }
         }
-        if (need_tickle)
+        // 每个任务最多唤醒一个休眠的工作线程
+        while (count-- > 0)
         {
             tickle();
         }
@@ -128,23 +321,151 @@ public: // 实例方法
 
 protected:
     void run();
+    // 有新任务时唤醒一个休眠的工作线程，没有休眠的线程时不做任何事
     virtual void tickle();
     // 调度器停止时的回调函数，返回调度器当前是否处于停止工作的状态
     virtual bool onStop() { return isStop(); }
-    // 调度器空闲时的回调函数
-    virtual void onIdle()
-    {
-        while (!isStop())
-        {
-            Fiber::YieldToHold();
-        }
-        return;
-    }
+    // 调度器空闲时的回调函数：短暂自旋等待新任务，仍然没有任务时休眠，直到被 tickle 唤醒
+    virtual void onIdle();
 
 private:
+    /**
+     * @brief 一个工作线程的统计数据
+     * 每个工作线程一份，外部线程提交任务与唤醒线程的计数记录在调度器的公共一份中，
+     * 只使用 relaxed 原子操作，读取时各字段之间可能不完全一致
+     * */
+    struct alignas(64) Stats
+    {
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> parks{0};
+        std::atomic<uint64_t> unparks{0};
+        // 已经结束的忙碌与空闲时间段的累计时间
+        std::atomic<uint64_t> busy_ns{0};
+        std::atomic<uint64_t> idle_ns{0};
+        // 当前忙碌或者空闲时间段的开始时间，0 表示不处于该状态
+        std::atomic<uint64_t> busy_since{0};
+        std::atomic<uint64_t> idle_since{0};
+        // 是否正在执行任务，只由工作线程自己写入，取代所有线程共享的活跃线程计数
+        std::atomic<uint64_t> active{0};
+        AtomicLog2Histogram wait_ns;
+    };
+
+    /**
+     * @brief 工作线程正在执行的任务，由工作线程写入，监控线程采样
+     * 各字段分别原子更新，采样结果与并发的任务切换之间可能不完全一致
+     * */
+    struct RunSlot
+    {
+        // 开始执行的时间，0 表示没有在执行任务
+        std::atomic<uint64_t> since{0};
+        // 每开始执行一次任务加一，watchdog 据此对同一次运行只报告一次
+        std::atomic<uint64_t> seq{0};
+        std::atomic<uint64_t> fiber_id{0};
+        std::atomic<const std::type_info*> entry{nullptr};
+        // watchdog 请求正在运行的协程让出执行权
+        std::atomic<bool> preempt{false};
+    };
+
+    /**
+     * @brief 工作线程
+     * */
+    struct Worker
+    {
+        // 工作窃取模式下本线程产生的任务，本线程从底部存取，其他线程从顶部窃取
+        WorkStealDeque<Task*> deque;
+        // 绑定本线程的任务，任意线程加入，只由本线程取出
+        MpscQueue<Task> inbox;
+        // 使用该队列的线程 id，-1 表示还没有线程开始调度
+        std::atomic<long> thread_id{-1};
+        // 本线程连续执行本地任务的次数，用于定期检查全局队列
+        uint64_t local_tick = 0;
+        // 选择窃取对象的随机数状态
+        uint64_t random_state = 0;
+        Stats stats;
+        RunSlot run;
+        // 监控线程最近一次报告的运行序号，只由监控线程访问
+        uint64_t reported_seq = 0;
+        // 本线程连续空闲（没有执行任务）的开始时间，0 表示正在执行任务，只由本线程访问
+        uint64_t idle_streak_since = 0;
+        // 弹性模式下本线程因为长时间空闲而退出
+        bool retiring = false;
+
+        ~Worker();
+    };
+
+    // 当前线程在本调度器中的工作线程，不是本调度器的工作线程时返回 nullptr
+    Worker* localWorker();
+    // 按任务绑定的线程和调度模式将任务加入对应的队列，并唤醒工作线程
+    void submit(Task* task, bool instant);
+    // 在调度协程上直接执行不会让出执行权的任务
+    void runInline(Task* task);
+    // 任务加入队列前调用：记录提交数量与加入队列的时间
+    void onEnqueue(Task* task);
+    // 当前线程记录统计数据的位置：工作线程使用自己的一份，其他线程使用公共的一份
+    Stats& localStats();
+    // 将任务加入工作线程的本地队列
+    void scheduleLocal(Worker* worker, Task* task);
+    // 查找指定线程的工作线程，该线程没有在本调度器中调度时返回 nullptr
+    Worker* findWorker(long thread_id);
+    // 将绑定线程的任务加入目标线程的收件箱并唤醒该线程
+    void scheduleInbox(Worker* worker, Task* task);
+    // 加入收件箱之后发现目标线程已经退出：收件箱没有了消费者，其中的任务转入全局队列
+    void rescueInbox(Worker* worker);
+    // 从本线程的收件箱取出任务
+    Task* takeInboxTask(Worker* worker);
+    // 从全局队列中取出一个当前线程可以执行的任务
+    Task* takeGlobalTask(Worker* worker, bool& tickle_me);
+    // 从本线程的队列取出任务，steal 为 true 时从随机选择的其他工作线程窃取
+    Task* takeLocalTask(Worker* worker, bool steal);
+    // 将任务加入全局队列 non-thread-safe
+    void pushGlobalTask(Task* task, bool front);
+    // 从全局队列的一个优先级中取出当前线程可以执行的任务 non-thread-safe
+    Task* takeGlobalTask(size_t level);
+    // 当前线程是否可以执行该任务
+    static bool Runnable(const Task* task);
+    // 记录工作线程开始执行任务
+    void beginRun(Worker* worker, uint64_t now, uint64_t fiber_id, const std::type_info& entry);
+    // 记录工作线程结束（或者挂起）正在执行的任务
+    void endRun(Worker* worker);
+    // 当前线程正在执行的任务是否被请求抢占，返回 true 时清除请求，由 Fiber::MaybeYield 调用
+    static bool PreemptRequested();
+    // 监控线程的执行函数：定期执行 watchdog 检查与弹性调整
+    void monitorMain();
+    // 通知监控线程退出并等待
+    void stopMonitor();
+    // 采样各工作线程，请求抢占超过时间片的协程，记录超过预算的任务
+    void checkLongRuns();
+    // 弹性模式：根据采样窗口内的排队等待时间决定是否增加工作线程
+    void adjustWorkers(uint64_t now);
+    // 弹性模式：创建一个工作线程，并回收已经退出的线程
+    void spawnWorker();
+    // 弹性模式：当前工作线程是否应当退出，返回 true 时计入正在退出的线程数量
+    bool tryRetire();
+    // 工作线程退出：注销线程 id，剩余的任务转入全局队列。
+    // 弹性模式下退出的线程同时归还槽位并从线程数量中扣除
+    void releaseWorker(Worker* worker);
+    // 为开始调度的线程分配一个工作线程槽位并登记线程 id
+    size_t claimWorker();
+    // 相对当前时间 ms 毫秒之后的截止时间
+    static uint64_t DeadlineFromNow(uint64_t ms);
+
+    // 休眠中的工作线程
+    struct Parker;
+    // 是否存在当前线程可以执行的任务
+    bool hasPendingTask();
+    // 当前线程休眠，直到被 unpark 唤醒或者超时
+    void park();
+    /**
+     * @brief 唤醒休眠的工作线程
+     * @param thread_id 只唤醒指定的线程，-1 表示任意一个线程
+     * @param all 是否唤醒所有休眠的线程
+     * */
+    void unpark(long thread_id, bool all);
+
     /**
      * @brief 添加任务 non-thread-safe
-     * @param Executable 模板类型必须是 std::unique_ptr<zjl::Fiber> 或者 std::function
+     * @param Executable 模板类型必须是 Fiber::ptr 或者可调用对象
      * @param exec Executable 的实例
      * @param thread_id 任务要绑定执行线程的 id
      * @param instant 是否优先调度
@@ -153,16 +474,18 @@ private:
     template <typename Executable>
     bool scheduleNonBlock(Executable&& exec, long thread_id = -1, bool instant = false)
     {
-        bool need_tickle = m_task_list.empty();
+        bool need_tickle = (m_global_task_count == 0);
         // std::forward
-        auto task = std::make_unique<Task>(std::forward<Executable>(exec), thread_id);
-        // 创建的任务实例存在有效的 zjl::Fiber 或 std::function
+        Task* task = Task::Create(std::forward<Executable>(exec), thread_id);
+        // 创建的任务实例存在有效的 zjl::Fiber 或可调用对象
         if (task->fiber || task->callback)
         {
-            if (instant)
-                m_task_list.push_front(std::move(task));
-            else
-                m_task_list.push_back(std::move(task));
+            onEnqueue(task);
+            pushGlobalTask(task, instant);
+        }
+        else
+        {
+            Task::Destroy(task);
         }
         return need_tickle;
     }
@@ -175,12 +498,10 @@ protected:
     std::vector<long> m_thread_id_list;
     // 有效线程数量
     size_t m_thread_count = 0;
-    // 活跃线程数量
-    std::atomic_uint64_t m_active_thread_count{};
     // 空闲线程数量
     std::atomic_uint64_t m_idle_thread_count{};
     // 执行停止状态
-    bool m_stopping = true;
+    std::atomic<bool> m_stopping{true};
     // 是否自动停止
     bool m_auto_stop = false;
 
@@ -190,8 +511,87 @@ private:
     Fiber::ptr m_root_fiber;
     // 线程对象列表
     std::vector<Thread::ptr> m_thread_list;
-    // 任务集合
-    std::list<Task::ptr> m_task_list;
+    /**
+     * @brief 全局队列中一个优先级的任务
+     * */
+    struct TaskQueue
+    {
+        // 没有截止时间的任务，先进先出
+        Task* head = nullptr;
+        Task* tail = nullptr;
+        // 设置了截止时间的任务，按截止时间组织的小顶堆
+        std::vector<Task*> deadlines;
+        // 因为更高优先级的任务而被连续跳过的次数
+        uint64_t skipped = 0;
+
+        bool empty() const { return head == nullptr && deadlines.empty(); }
+    };
+    // TaskQueue::deadlines 小顶堆的比较函数
+    struct LaterDeadline
+    {
+        bool operator()(const Task* lhs, const Task* rhs) const
+        {
+            return lhs->deadline_ns > rhs->deadline_ns;
+        }
+    };
+    // 全局队列，按优先级分为多个队列，工作窃取模式下作为全局注入队列
+    TaskQueue m_queues[kPriorityCount];
+    // 是否启用工作窃取模式
+    bool m_work_stealing = false;
+    // 每个工作线程的任务队列
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    // 空闲的工作线程槽位，由 m_mutex 保护
+    std::vector<size_t> m_free_workers;
+    // 全局队列中的任务数量，用于不加锁地判断是否有任务
+    std::atomic<size_t> m_global_task_count{0};
+    // 全局队列中高优先级或者设置了截止时间的任务数量，工作窃取模式下存在这类任务时先检查全局队列
+    std::atomic<size_t> m_urgent_task_count{0};
+    // 是否统计等待时间与忙闲时间
+    bool m_metrics = true;
+    // 外部线程提交任务、唤醒线程的统计数据
+    Stats m_external_stats;
+    // 任务连续运行的预算与时间片（纳秒），预算为 0 表示不启动 watchdog
+    uint64_t m_watchdog_budget_ns = 0;
+    uint64_t m_time_slice_ns = 0;
+    // 监控线程的采样间隔
+    uint64_t m_monitor_interval_ms = 0;
+    // 执行 watchdog 检查与弹性调整的监控线程，两者都没有开启时不启动
+    Thread::ptr m_monitor_thread;
+    // 保护监控线程的停止状态与记录
+    mutable Mutex m_monitor_mutex;
+    // 停止调度器时通知监控线程退出
+    Condition m_monitor_cond;
+    bool m_monitor_stopping = false;
+    // 弹性模式：创建的线程数量上限（不包括 use_caller 时的当前线程），等于 m_thread_count 时不开启弹性模式
+    size_t m_max_thread_count = 0;
+    // 弹性模式：增加线程的等待时间阈值与空闲线程退出的时间（纳秒）
+    uint64_t m_grow_wait_ns = 0;
+    uint64_t m_retire_idle_ns = 0;
+    // 弹性模式：正在运行的创建线程数量（不包括 use_caller 时的当前线程），
+    // 只在持有 m_mutex 时修改，退出的线程归还槽位时才扣除
+    std::atomic<size_t> m_live_threads{0};
+    // 弹性模式：已经决定退出、还没有归还槽位的线程数量，由 m_mutex 保护
+    size_t m_retiring_threads = 0;
+    // 弹性模式：已经创建过的线程数量，用于线程命名
+    size_t m_spawned_threads = 0;
+    // 弹性模式：已经退出、等待回收的线程 id，由 m_mutex 保护
+    std::vector<long> m_retired_threads;
+    // 弹性模式：最近一次增加线程的时间
+    std::atomic<uint64_t> m_last_grow_ns{0};
+    // 弹性模式：上一次采样时的等待时间累计值、等待任务数与采样时间，只由监控线程访问
+    uint64_t m_sample_wait_sum = 0;
+    uint64_t m_sample_wait_count = 0;
+    uint64_t m_sample_ns = 0;
+    // 弹性模式：排队等待时间连续超过阈值的采样次数
+    uint64_t m_grow_streak = 0;
+    // 按入口函数汇总的超过预算的记录
+    std::unordered_map<std::type_index, LongRun> m_long_runs;
+    // 保护休眠线程链表
+    Mutex m_park_mutex;
+    // 休眠线程链表
+    Parker* m_parked = nullptr;
+    // 休眠线程数量，为 0 时 tickle 不需要加锁
+    std::atomic<size_t> m_parked_count{0};
 };
 
 
@@ -2,11 +2,13 @@
 #define __THREAD_H__
 
 #include <functional>
+#include <string>
 #include <memory>
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "noncopyable.h"
@@ -158,9 +160,63 @@ public:
     }
 
 private:
+    friend class Condition;
+
     pthread_mutex_t m_mutex{};
 };
 
+// 封装条件变量，配合 Mutex 使用，超时基于单调时钟
+class Condition : public noncopyable {
+public:
+    Condition()
+    {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&m_cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+
+    ~Condition()
+    {
+        pthread_cond_destroy(&m_cond);
+    }
+
+    // 释放 mutex 并等待，被唤醒后重新获得 mutex，调用者需要持有 mutex
+    int wait(Mutex& mutex)
+    {
+        return pthread_cond_wait(&m_cond, &mutex.m_mutex);
+    }
+
+    // 最多等待 ms 毫秒，超时返回 false
+    bool waitFor(Mutex& mutex, uint64_t ms)
+    {
+        timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += ms / 1000;
+        deadline.tv_nsec += (ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+        return pthread_cond_timedwait(&m_cond, &mutex.m_mutex, &deadline) == 0;
+    }
+
+    int notifyOne()
+    {
+        return pthread_cond_signal(&m_cond);
+    }
+
+    int notifyAll()
+    {
+        return pthread_cond_broadcast(&m_cond);
+    }
+
+private:
+    pthread_cond_t m_cond{};
+};
+
 // 封装读写锁     
 class RWLock {
 public:
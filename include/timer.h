@@ -1,42 +1,62 @@
 #ifndef __TIMER_H__
 #define __TIMER_H__
 
+#include "config.h"
+#include "thread.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <set>
 #include <vector>
-#include <memory>
-#include "thread.h"
+
+namespace TimerInfo
+{
+// 是否使用分层时间轮保存定时器：加入、取消、刷新都是 O(1)，到期时按槽位成批取出；
+// 关闭时使用按到期时间排序的 std::set。在定时器管理器构造时读取
+static ConfigVar<bool>::ptr g_use_wheel =
+    Config::Lookup<bool>("timer.use_wheel", true);
+} // namespace TimerInfo
 
 class TimerManager;
 
-class Timer: std::enable_shared_from_this<Timer> {
+class Timer : public std::enable_shared_from_this<Timer> {
 friend class TimerManager;
 public:
     using ptr = std::shared_ptr<Timer>;
 
     bool cancel();
     // 设置定时间隔
-    bool reset(uint64_t ms, bool form_now);
+    bool reset(uint64_t ms, bool from_now);
     // 重置定时器
     bool refresh();
 
 private:
     // 参数：定时时间，回调函数，重复执行，执行环境
-    Timer(uint64_t ms, std::function<void()> fn, bool cycle, TimerManager* manager);
+    Timer(uint64_t ms, std::function<void()> fn, bool cyclic, TimerManager* manager);
     // 只有时间参数，超时计时器
     Timer(uint64_t next);
 
 private:
-    bool m_cycle = false;
-    uint64_t m_ms; // 执行周期
-    uint64_t m_next;
+    bool m_cyclic = false;
+    uint64_t m_ms = 0; // 执行周期
+    uint64_t m_next = 0; // 到期的绝对时间（毫秒）
     std::function<void()> m_fn;
     TimerManager* m_manager = nullptr;
 
+    // 时间轮槽位中的双向链表，m_wheel_level 为 -1 表示不在时间轮中
+    Timer* m_wheel_prev = nullptr;
+    Timer* m_wheel_next = nullptr;
+    int m_wheel_level = -1;
+    uint32_t m_wheel_index = 0;
+    // 在时间轮中时持有自身，槽位中只保存裸指针
+    Timer::ptr m_wheel_self;
+
 private:
     struct Comparator {
         bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
     };
-}
+};
 
 // 定时器调度类
 class TimerManager {
@@ -44,27 +64,46 @@ friend class Timer;
 
 public:
     TimerManager();
-    virtual ~TimerManager()last_modify
-    
-    Timer::ptr addTimer(uint64_t ms, std::function<void()> fn, bool cycle = false);
+    virtual ~TimerManager();
+
+    Timer::ptr addTimer(uint64_t ms, std::function<void()> fn, bool cyclic = false);
     // 条件计时器，weak_cond 是条件参数
-    Timer::ptr addContionalTimer(uint64_t ms, std::function<void()> fn, 
-                        std::weak_ptr<void> weak_cond, bool cycle = false);
-    // 下一个定时器的等待时间
+    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> fn,
+                        std::weak_ptr<void> weak_cond, bool cyclic = false);
+    // 下一个定时器的等待时间，使用时间轮时可能早于实际的到期时间（需要级联的时刻）
     uint64_t getNextTimer();
     // 获取所有等待超时的定时器的回调函数对象，并将定时器从队列中移除。周期调用的定时器存回队列
     void listExpiredCallback(std::vector<std::function<void()>>& fns);
     // 是否有等待执行的定时器
     bool hasTimer();
+    // 等待执行的定时器数量
+    size_t timerCount();
 
 protected:
+    // 加入的定时器比等待中的线程预期的下一次到期更早时调用，用于唤醒等待的线程
+    virtual void onTimerInsertedAtFirst() {}
     // 监察系统时间是否被修改为更早的时间
     bool detectClockRollover(uint64_t now_ms);
 
 private:
+    // 加入新的定时器，返回前释放写锁，需要时调用 onTimerInsertedAtFirst
+    void addTimer(Timer::ptr timer, WriteScopedLock& lock);
+    // 把定时器放入容器，返回是否需要通知等待的线程。调用时持有写锁
+    bool insertTimer(Timer* timer);
+    // 从容器中移除定时器，返回定时器是否在容器中。release 为 false 时保留时间轮对定时器的引用，
+    // 用于马上重新放入。调用时持有写锁
+    bool removeTimer(Timer* timer, bool release);
+
+private:
+    struct TimingWheel;
+
     RWLock m_lock;
     std::set<Timer::ptr, Timer::Comparator> m_timers;
+    // 为空时使用 m_timers
+    std::unique_ptr<TimingWheel> m_wheel;
     uint64_t m_previous_time = 0;
-}
+    // 等待的线程预期的下一次到期时间，早于它的定时器加入时才需要通知
+    std::atomic<uint64_t> m_notify_before{~0ull};
+};
 
-#endif  // __TIMER_H__
\ No newline at end of file
+#endif  // __TIMER_H__
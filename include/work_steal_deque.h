@@ -0,0 +1,153 @@
+#ifndef __WORK_STEAL_DEQUE_H__
+#define __WORK_STEAL_DEQUE_H__
+
+#include "noncopyable.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Chase-Lev 工作窃取双端队列
+ * 所有者线程在底部 push/pop（后进先出），其他线程在顶部 steal（先进先出），
+ * 只有队列中最后一个元素的争用需要 CAS。内存序参照 Lê 等人的 C11 实现。
+ * 容量不足时所有者线程将缓冲区扩容一倍，旧缓冲区可能仍在被窃取者读取，保留到队列析构时释放。
+ * @tparam T 元素类型，必须可以平凡复制（通常是指针）
+*/
+template <typename T>
+class WorkStealDeque : public noncopyable
+{
+    static_assert(std::is_trivially_copyable<T>::value, "WorkStealDeque 的元素必须可以平凡复制");
+
+public:
+    explicit WorkStealDeque(int64_t capacity = 256)
+        : m_top(0), m_bottom(0)
+    {
+        int64_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        m_buffers.emplace_back(new Buffer(size));
+        m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 在底部加入元素，只能由所有者线程调用
+     * */
+    void push(T item)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_acquire);
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        if (bottom - top > buffer->mask)
+        {
+            buffer = grow(buffer, top, bottom);
+        }
+        buffer->put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 从底部取出元素，只能由所有者线程调用
+     * @return 队列为空或者最后一个元素被窃取时返回 false
+     * */
+    bool pop(T& item)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        if (top > bottom)
+        {
+            // 队列为空
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = buffer->get(bottom);
+        if (top == bottom)
+        {
+            // 最后一个元素，与窃取者竞争
+            bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 从顶部窃取元素 thread-safe
+     * @return 队列为空或者与其他线程竞争失败时返回 false
+     * */
+    bool steal(T& item)
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+        {
+            return false;
+        }
+        Buffer* buffer = m_buffer.load(std::memory_order_acquire);
+        item = buffer->get(top);
+        return m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed);
+    }
+
+    // 近似的元素数量，其他线程读取时可能已经过时
+    size_t size() const
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    // 环形缓冲区，容量是 2 的幂
+    struct Buffer
+    {
+        explicit Buffer(int64_t capacity)
+            : mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+
+        T get(int64_t index) const
+        {
+            return slots[index & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T item)
+        {
+            slots[index & mask].store(item, std::memory_order_relaxed);
+        }
+
+        const int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+    };
+
+    Buffer* grow(Buffer* buffer, int64_t top, int64_t bottom)
+    {
+        m_buffers.emplace_back(new Buffer((buffer->mask + 1) * 2));
+        Buffer* bigger = m_buffers.back().get();
+        for (int64_t i = top; i < bottom; ++i)
+        {
+            bigger->put(i, buffer->get(i));
+        }
+        m_buffer.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    // 窃取端与所有者端位于不同的缓存行，避免伪共享
+    alignas(64) std::atomic<int64_t> m_top;
+    alignas(64) std::atomic<int64_t> m_bottom;
+    std::atomic<Buffer*> m_buffer;
+    // 所有分配过的缓冲区，只由所有者线程修改
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+};
+
+#endif // __WORK_STEAL_DEQUE_H__
@@ -0,0 +1,125 @@
+#include "blocking_executor.h"
+#include "log.h"
+#include <cassert>
+
+BlockingExecutor::BlockingExecutor(size_t max_threads, uint64_t keep_alive_ms, std::string name)
+    : m_name(std::move(name)),
+      m_max_threads(max_threads == 0 ? 1 : max_threads),
+      m_keep_alive_ms(keep_alive_ms)
+{
+}
+
+BlockingExecutor::~BlockingExecutor()
+{
+    ScopedLock lock(&m_mutex);
+    m_stopping = true;
+    m_job_cond.notifyAll();
+    // 线程在执行完队列中的操作后退出
+    while (m_thread_count > 0)
+    {
+        m_exit_cond.wait(m_mutex);
+    }
+}
+
+void BlockingExecutor::submit(Job job)
+{
+    if (!job)
+    {
+        return;
+    }
+    bool spawn = false;
+    uint64_t index = 0;
+    {
+        ScopedLock lock(&m_mutex);
+        assert(!m_stopping);
+        m_jobs.push_back(std::move(job));
+        // 空闲线程不足以处理排队的操作时创建新线程
+        if (m_jobs.size() > m_idle_count && m_thread_count < m_max_threads)
+        {
+            spawn = true;
+            index = m_spawned++;
+            ++m_thread_count;
+        }
+        m_job_cond.notifyOne();
+    }
+    if (spawn)
+    {
+        // 线程对象析构时分离线程，线程退出时自行减少计数
+        try
+        {
+            Thread thread(std::bind(&BlockingExecutor::workerMain, this),
+                          m_name + "_" + std::to_string(index));
+        }
+        catch (...)
+        {
+            ScopedLock lock(&m_mutex);
+            --m_thread_count;
+            if (m_thread_count == 0)
+            {
+                m_exit_cond.notifyAll();
+            }
+            throw;
+        }
+    }
+}
+
+size_t BlockingExecutor::threadCount() const
+{
+    ScopedLock lock(&m_mutex);
+    return m_thread_count;
+}
+
+size_t BlockingExecutor::idleCount() const
+{
+    ScopedLock lock(&m_mutex);
+    return m_idle_count;
+}
+
+size_t BlockingExecutor::pendingCount() const
+{
+    ScopedLock lock(&m_mutex);
+    return m_jobs.size();
+}
+
+void BlockingExecutor::workerMain()
+{
+    ScopedLock lock(&m_mutex);
+    while (true)
+    {
+        bool timed_out = false;
+        while (m_jobs.empty() && !m_stopping && !timed_out)
+        {
+            ++m_idle_count;
+            timed_out = !m_job_cond.waitFor(m_mutex, m_keep_alive_ms);
+            --m_idle_count;
+        }
+        if (m_jobs.empty())
+        {
+            // 空闲超时或者线程池停止
+            break;
+        }
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        lock.unlock();
+        try
+        {
+            job();
+        }
+        catch (std::exception& e)
+        {
+            ERROR("BlockingExecutor job exception: %s", e.what());
+        }
+        catch (...)
+        {
+            ERROR("BlockingExecutor job exception");
+        }
+        // 在锁外销毁操作对象，其中可能持有协程等资源
+        job = nullptr;
+        lock.lock();
+    }
+    --m_thread_count;
+    if (m_thread_count == 0)
+    {
+        m_exit_cond.notifyAll();
+    }
+}
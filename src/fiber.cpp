@@ -1,11 +1,25 @@
 #include "fiber.h"
 #include "exception.h"
 #include "log.h"
+#include "profiler.h"
 #include "scheduler.h"
 #include <cassert>
 #include <cerrno>
+#include <algorithm>
 #include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
 #include <utility>
+#include <vector>
+
+namespace FiberInfo
+{
+std::atomic_uint64_t s_fiber_id{0};
+std::atomic_uint64_t s_fiber_count{0};
+thread_local Fiber* t_fiber = nullptr;
+thread_local Fiber::ptr t_master_fiber{};
+} // namespace FiberInfo
 
 /*
  * @brief 对 malloc/free 简单封装的内存分配器
@@ -13,21 +27,193 @@
 class MallocStackAllocator
 {
 public:
-    static void* Alloc(uint64_t size)
+    static void* Alloc(uint64_t size, bool /*hugepage*/ = false)
     {
         return ::malloc(size);
     }
 
-    static void Dealloc(void* ptr, uint64_t size)
+    static void Dealloc(void* ptr, uint64_t /*size*/, bool /*hugepage*/ = false)
     {
         free(ptr);
     }
 };
 
+/**
+ * @brief 基于 mmap 的协程栈分配器
+ * 每个栈的低地址端额外映射一个 PROT_NONE 的保护页，栈溢出时直接触发 SIGSEGV，而不是悄悄写坏堆内存。
+ * 释放的栈按尺寸等级挂到线程局部的空闲链表中复用，避免频繁的 mmap/munmap 系统调用。
+ * 空闲链表中超过 "fiber.stack_pool.hot_count" 的栈可选地通过 MADV_DONTNEED 归还物理内存，
+ * 超过 "fiber.stack_pool.max_count" 的栈直接 munmap。
+ * 映射使用 MAP_NORESERVE，只保留虚拟地址空间，物理页在首次访问时才由内核分配，
+ * 因此可以为每个协程保留很大的栈（"fiber.stack_reserve"），常驻内存只取决于实际使用量。
+ * hugepage 为 true 时对栈空间 MADV_HUGEPAGE，使用透明大页减少 TLB 缺失，这类栈在独立的空闲链表中复用。
+*/
+class MmapStackAllocator
+{
+public:
+    static void* Alloc(uint64_t size, bool hugepage = false)
+    {
+        const uint64_t size_class = SizeClass(size);
+        auto& free_list = GetPool().free_lists[PoolKey(size_class, hugepage)];
+        if (!free_list.empty())
+        {
+            void* stack = free_list.back();
+            free_list.pop_back();
+            return stack;
+        }
+        const uint64_t page_size = PageSize();
+        void* base = ::mmap(nullptr, size_class + page_size,
+                            PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            throw Exception(std::string(::strerror(errno)));
+        }
+        // 栈向低地址增长，保护页放在映射区域的最低处
+        if (::mprotect(base, page_size, PROT_NONE))
+        {
+            int saved_errno = errno;
+            ::munmap(base, size_class + page_size);
+            throw Exception(std::string(::strerror(saved_errno)));
+        }
+        void* stack = static_cast<char*>(base) + page_size;
+#ifdef MADV_HUGEPAGE
+        if (hugepage)
+        {
+            // 内核不支持透明大页时失败，退化为普通页，不影响使用
+            ::madvise(stack, size_class, MADV_HUGEPAGE);
+        }
+#endif
+        return stack;
+    }
+
+    static void Dealloc(void* ptr, uint64_t size, bool hugepage = false)
+    {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+        const uint64_t size_class = SizeClass(size);
+        auto& free_list = GetPool().free_lists[PoolKey(size_class, hugepage)];
+        if (free_list.size() >= FiberInfo::g_stack_pool_max_count->getValue())
+        {
+            Unmap(ptr, size_class);
+            return;
+        }
+        if (free_list.size() >= FiberInfo::g_stack_pool_hot_count->getValue() &&
+            FiberInfo::g_stack_pool_madvise->getValue())
+        {
+            // 保留虚拟地址映射，只归还物理页，再次使用时由内核按需清零分配
+            ::madvise(ptr, size_class, MADV_DONTNEED);
+        }
+        free_list.push_back(ptr);
+    }
+
+private:
+    // 线程局部的栈缓存池，线程退出时释放所有缓存的栈
+    struct StackPool
+    {
+        // 尺寸等级（最低位标记是否使用透明大页）-> 空闲栈列表
+        std::unordered_map<uint64_t, std::vector<void*>> free_lists;
+
+        ~StackPool()
+        {
+            for (auto& item : free_lists)
+            {
+                for (void* stack : item.second)
+                {
+                    Unmap(stack, item.first & ~1ull);
+                }
+            }
+        }
+    };
+
+    // 尺寸等级是页大小的整数倍，最低位空闲，用来区分透明大页栈
+    static uint64_t PoolKey(uint64_t size_class, bool hugepage)
+    {
+        return size_class | (hugepage ? 1 : 0);
+    }
+
+    static StackPool& GetPool()
+    {
+        static thread_local StackPool s_pool;
+        return s_pool;
+    }
+
+    static uint64_t PageSize()
+    {
+        static const uint64_t s_page_size = ::sysconf(_SC_PAGESIZE);
+        return s_page_size;
+    }
+
+    // 尺寸等级：向上取整到 2 的幂次个内存页
+    static uint64_t SizeClass(uint64_t size)
+    {
+        uint64_t size_class = PageSize();
+        while (size_class < size)
+        {
+            size_class <<= 1;
+        }
+        return size_class;
+    }
+
+    static void Unmap(void* stack, uint64_t size_class)
+    {
+        const uint64_t page_size = PageSize();
+        ::munmap(static_cast<char*>(stack) - page_size, size_class + page_size);
+    }
+};
+
+/**
+ * @brief 预留模式（"fiber.stack_reserve"）下每个协程至少保留 "fiber.stack_reserve_size" 的地址空间，
+ * 物理内存按实际使用量分配
+*/
+static uint64_t ReservedStackSize(uint64_t stack_size)
+{
+    if (FiberInfo::g_stack_reserve->getValue())
+    {
+        return std::max<uint64_t>(stack_size, FiberInfo::g_stack_reserve_size->getValue());
+    }
+    return stack_size;
+}
+
 /**
  * @brief 协程栈空间分配器
+ * 定义 FIBER_STACK_MALLOC 时使用 malloc 分配，用于对比测试
 */
+#ifdef FIBER_STACK_MALLOC
 using StackAllocator = MallocStackAllocator;
+#else
+using StackAllocator = MmapStackAllocator;
+#endif
+
+/**
+ * @brief 线程共享栈
+ * 共享栈模式的协程都运行在所在线程的这块栈上，同一时刻只有一个占用者，
+ * 其他挂起的协程把各自使用过的栈内容保存在私有缓冲区中（参考 libco 的 copy-stack）
+*/
+struct Fiber::SharedStack
+{
+    void* stack;
+    uint64_t size;
+    // 当前栈上的内容属于哪个协程
+    Fiber* occupant;
+
+    SharedStack()
+        : stack(nullptr),
+          size(FiberInfo::g_shared_stack_size->getValue()),
+          occupant(nullptr)
+    {
+        stack = StackAllocator::Alloc(size);
+    }
+
+    ~SharedStack()
+    {
+        // 占用者持有共享栈，最后一个持有者释放时不会再有占用者
+        assert(occupant == nullptr);
+        StackAllocator::Dealloc(stack, size);
+    }
+};
 
 /**
  * ===============================
@@ -41,45 +227,67 @@ Fiber::Fiber()
       m_state(EXEC),
       m_ctx(),
       m_stack(nullptr),
-      m_callback()
+      m_stack_hugepage(false),
+      m_callback(),
+      m_shared_stack(false),
+      m_shared_owner(),
+      m_shared_thread(-1),
+      m_save_buffer(nullptr),
+      m_save_size(0),
+      m_save_capacity(0),
+      m_entry_type(nullptr),
+      m_stack_used(0),
+      m_locals()
 {
     SetThis(this);
+#if !FIBER_USE_ASM_CONTEXT
     // 获取上下文对象的副本
     if (getcontext(&m_ctx))
     {
-        throw (std::string(::strerroExceptionr(errno)));
+        throw Exception(std::string(::strerror(errno)));
     }
+#endif
     // 存在协程数量增加
     ++FiberInfo::s_fiber_count;
-    DEBUG("调用 Fiber::Fiber 创建 master fiber，thread_id = %ld, fiber_id = %ld",
-            GetThreadID(), m_id);
+    VERBOSE("调用 Fiber::Fiber 创建 master fiber，thread_id = %ld, fiber_id = %ld",
+            static_cast<long>(Log::GetThreadId()), static_cast<long>(m_id));
 }
 
-Fiber::Fiber(FiberFunc callback, size_t stack_size)
+Fiber::Fiber(FiberFunc callback, size_t stack_size, bool shared_stack)
     : m_id(++FiberInfo::s_fiber_id),
       m_stack_size(stack_size),
       m_state(INIT),
       m_ctx(),
       m_stack(nullptr),
-      m_callback(std::move(callback))
+      m_stack_hugepage(false),
+      m_callback(std::move(callback)),
+      m_shared_stack(shared_stack && FIBER_USE_ASM_CONTEXT),
+      m_shared_owner(),
+      m_shared_thread(-1),
+      m_save_buffer(nullptr),
+      m_save_size(0),
+      m_save_capacity(0),
+      m_entry_type(nullptr),
+      m_stack_used(0),
+      m_locals()
 {
     // 如果传入的 stack_size 为 0，使用配置项 "fiber.stack_size" 设置的值
     if (m_stack_size == 0)
     {
         m_stack_size = FiberInfo::g_fiber_stack_size->getValue();
     }
-    // 获取上下文对象的副本
-    if (getcontext(&m_ctx))
+    m_stack_size = ReservedStackSize(m_stack_size);
+    m_run_entry = &m_callback.target_type();
+    // 共享栈协程在首次换入时才绑定线程共享栈并初始化上下文
+    if (!m_shared_stack)
     {
-        throw Exception(std::string(::strerror(errno)));
+        // 给上下文对象分配分配新的栈空间内存
+        m_stack_hugepage = FiberInfo::g_stack_hugepage->getValue();
+        m_stack = StackAllocator::Alloc(m_stack_size, m_stack_hugepage);
+        prepareStackProfile();
     }
-    // 给上下文对象分配分配新的栈空间内存
-    m_stack = StackAllocator::Alloc(m_stack_size);
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stack_size;
     // 给新的上下文绑定入口函数
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
+    makeContext();
 
     ++FiberInfo::s_fiber_count;
 //    LOG_FMT_DEBUG(system_logger,
@@ -101,14 +309,21 @@ Fiber::Fiber(FiberFunc callback, size_t stack_size)
 
 Fiber::~Fiber()
 {
+    clearLocals();
 //    LOG_FMT_DEBUG(system_logger,
 //                  "调用 Fiber::~Fiber 析构协程，thread_id = %ld, fiber_id = %ld",
 //                  GetThreadID(), m_id);
-    if (m_stack) // 存在栈，说明是子协程，释放申请的协程栈空间
+    if (m_shared_stack) // 共享栈子协程，只释放私有缓冲区
+    {
+        assert(m_state == INIT || m_state == TERM || m_state == EXCEPTION);
+        releaseSharedStack();
+        ::free(m_save_buffer);
+    }
+    else if (m_stack) // 存在栈，说明是子协程，释放申请的协程栈空间
     {
         // 只有子协程未被启动或者执行结束，才能被析构，否则属于程序错误
         assert(m_state == INIT || m_state == TERM || m_state == EXCEPTION);
-        StackAllocator::Dealloc(m_stack, m_stack_size);
+        StackAllocator::Dealloc(m_stack, m_stack_size, m_stack_hugepage);
     }
     else // 否则是 master fiber
     {
@@ -124,9 +339,40 @@ Fiber::~Fiber()
 
 void Fiber::reset(FiberFunc callback)
 {
-    assert(m_stack);
+    assert(m_stack || m_shared_stack);
     assert(m_state == INIT || m_state == TERM || m_state == EXCEPTION);
+    clearLocals();
     m_callback = std::move(callback);
+    m_run_entry = &m_callback.target_type();
+#ifdef FIBER_ACCOUNTING
+    m_run_ns = 0;
+    m_switch_count = 0;
+#endif
+    if (m_shared_stack)
+    {
+        // 重置后的共享栈协程可以重新绑定到其他线程
+        releaseSharedStack();
+        m_save_size = 0;
+    }
+    else
+    {
+        prepareStackProfile();
+    }
+    makeContext();
+    setState(INIT);
+}
+
+void Fiber::makeContext()
+{
+#if FIBER_USE_ASM_CONTEXT
+    if (m_shared_stack && m_shared_owner == nullptr)
+    {
+        // 尚未绑定共享栈，推迟到 occupySharedStack() 中初始化
+        m_ctx = nullptr;
+        return;
+    }
+    m_ctx = fiber_context_make(m_stack, m_stack_size, &Fiber::MainFunc);
+#else
     if (getcontext(&m_ctx))
     {
         throw Exception(std::string(::strerror(errno)));
@@ -135,7 +381,44 @@ void Fiber::reset(FiberFunc callback)
     m_ctx.uc_stack.ss_sp = m_stack;
     m_ctx.uc_stack.ss_size = m_stack_size;
     makecontext(&m_ctx, &Fiber::MainFunc, 0);
-    m_state = INIT;
+#endif
+}
+
+void Fiber::SwapContext(Fiber* from, Fiber* to)
+{
+#ifdef FIBER_ACCOUNTING
+    // 换出方停止运行、换入方开始运行的时间点，master fiber（id 为 0）不参与统计
+    uint64_t now = FiberAccounting::Now();
+    if (from->m_id != 0 && from->m_swap_in_ns != 0)
+    {
+        from->m_run_ns += now - from->m_swap_in_ns;
+        from->m_swap_in_ns = 0;
+        if (from->finish())
+        {
+            FiberAccounting::RecordFiber(*from->m_run_entry, from->m_run_ns,
+                                         from->m_switch_count);
+        }
+    }
+    if (to->m_id != 0)
+    {
+        to->m_swap_in_ns = now;
+        ++to->m_switch_count;
+    }
+#endif
+#if FIBER_USE_ASM_CONTEXT
+    if (to->m_shared_stack)
+    {
+        // 换入共享栈协程时会改写共享栈的内容，因此换出方不能运行在共享栈上
+        assert(!from->m_shared_stack && "共享栈协程之间不能直接切换");
+        to->occupySharedStack();
+    }
+    fiber_context_swap(&from->m_ctx, to->m_ctx);
+#else
+    if (swapcontext(&from->m_ctx, &to->m_ctx))
+    {
+        throw Exception(std::string(::strerror(errno)));
+    }
+#endif
 }
 
 void Fiber::swapIn()
@@ -145,14 +428,11 @@ void Fiber::swapIn()
     // 只有协程是等待执行的状态才能被换入
     assert(m_state == INIT || m_state == READY || m_state == HOLD);
     SetThis(this);
-    m_state = EXEC;
+    setState(EXEC);
     // 挂起 master fiber，切换到当前 fiber
     // if (swapcontext(&(FiberInfo::t_master_fiber->m_ctx), &m_ctx))
     assert(Scheduler::GetMainFiber() && "请勿手动调用该函数");
-    if (swapcontext(&(Scheduler::GetMainFiber()->m_ctx), &m_ctx))
-    {
-        throw Exception(std::string(::strerror(errno)));
-    }
+    SwapContext(Scheduler::GetMainFiber(), this);
 }
 
 void Fiber::swapOut()
@@ -164,10 +444,7 @@ void Fiber::swapOut()
     // 挂起当前 fiber，切换到 master fiber
     // if (swapcontext(&m_ctx, &(FiberInfo::t_master_fiber->m_ctx)))
     assert(Scheduler::GetMainFiber() && "请勿手动调用该函数");
-    if (swapcontext(&m_ctx, &(Scheduler::GetMainFiber()->m_ctx)))
-    {
-        throw Exception(std::string(::strerror(errno)));
-    }
+    SwapContext(this, Scheduler::GetMainFiber());
 }
 
 void Fiber::call()
@@ -175,11 +452,8 @@ void Fiber::call()
     assert(FiberInfo::t_master_fiber && "当前线程不存在主协程");
     assert(m_state == INIT || m_state == READY || m_state == HOLD);
     SetThis(this);
-    m_state = EXEC;
-    if (swapcontext(&(FiberInfo::t_master_fiber->m_ctx), &m_ctx))
-    {
-        throw Exception(std::string(::strerror(errno)));
-    }
+    setState(EXEC);
+    SwapContext(FiberInfo::t_master_fiber.get(), this);
 }
 
 void Fiber::back()
@@ -187,36 +461,172 @@ void Fiber::back()
     assert(FiberInfo::t_master_fiber && "当前线程不存在主协程");
     assert(m_stack);
     SetThis(FiberInfo::t_master_fiber.get());
-    if (swapcontext(&m_ctx, &(FiberInfo::t_master_fiber->m_ctx)))
-    {
-        throw Exception(std::string(::strerror(errno)));
-    }
+    SwapContext(this, FiberInfo::t_master_fiber.get());
 }
 
 void Fiber::swapIn(Fiber::ptr fiber)
 {
     assert(m_state == INIT || m_state == READY || m_state == HOLD);
     SetThis(this);
-    m_state = EXEC;
-    if (swapcontext(&(fiber->m_ctx), &m_ctx))
-    {
-        throw Exception(std::string(::strerror(errno)));
-    }
+    setState(EXEC);
+    SwapContext(fiber.get(), this);
 }
 
 void Fiber::swapOut(Fiber::ptr fiber)
 {
     assert(m_state);
     SetThis(fiber.get());
-    if (swapcontext(&m_ctx, &(fiber->m_ctx)))
+    SwapContext(this, fiber.get());
+}
+
+#if FIBER_USE_ASM_CONTEXT
+void Fiber::occupySharedStack()
+{
+    const std::shared_ptr<SharedStack>& shared = GetSharedStack();
+    assert((!m_shared_owner || m_shared_owner == shared) &&
+           "共享栈协程只能在首次运行的线程上调度");
+    if (shared->occupant != this)
     {
-        throw Exception(std::string(::strerror(errno)));
+        if (shared->occupant)
+        {
+            shared->occupant->saveSharedStack();
+        }
+        shared->occupant = this;
+        if (!m_shared_owner)
+        {
+            m_shared_owner = shared;
+            m_shared_thread = Log::GetThreadId();
+            m_stack = shared->stack;
+            m_stack_size = shared->size;
+        }
+        else if (m_save_size > 0)
+        {
+            // 把保存的栈内容复制回共享栈的原位置
+            char* top = static_cast<char*>(m_stack) + m_stack_size;
+            ::memcpy(top - m_save_size, m_save_buffer, m_save_size);
+        }
+    }
+    if (m_ctx == nullptr)
+    {
+        m_ctx = fiber_context_make(m_stack, m_stack_size, &Fiber::MainFunc);
+    }
+}
+
+void Fiber::saveSharedStack()
+{
+    m_save_size = 0;
+    // 已结束或尚未运行的协程没有需要保存的栈内容
+    if (finish() || m_ctx == nullptr)
+    {
+        return;
+    }
+    char* top = static_cast<char*>(m_stack) + m_stack_size;
+    // 挂起时保存的栈顶指针之上就是协程实际使用的栈空间
+    char* sp = static_cast<char*>(m_ctx);
+    size_t used = top - sp;
+    if (m_save_capacity < used)
+    {
+        ::free(m_save_buffer);
+        m_save_buffer = static_cast<char*>(::malloc(used));
+        if (m_save_buffer == nullptr)
+        {
+            m_save_capacity = 0;
+            throw Exception("Fiber::saveSharedStack malloc failed");
+        }
+        m_save_capacity = used;
+    }
+    ::memcpy(m_save_buffer, sp, used);
+    m_save_size = used;
+}
+#endif // FIBER_USE_ASM_CONTEXT
+
+void Fiber::releaseSharedStack()
+{
+    if (m_shared_owner && m_shared_owner->occupant == this)
+    {
+        m_shared_owner->occupant = nullptr;
+    }
+    // 绑定的线程已经退出时，最后一个绑定的协程在这里销毁共享栈
+    m_shared_owner.reset();
+    m_shared_thread = -1;
+    m_stack = nullptr;
+}
+
+void Fiber::prepareStackProfile()
+{
+    if (!FiberInfo::g_stack_profile->getValue())
+    {
+        m_entry_type = nullptr;
+        return;
+    }
+    if (m_entry_type)
+    {
+        // 复用的协程栈只有上次使用过的部分被改写
+        StackProfiler::Fill(static_cast<char*>(m_stack) + m_stack_size - m_stack_used,
+                            m_stack_used);
+    }
+    else
+    {
+        StackProfiler::Fill(m_stack, m_stack_size);
+    }
+    m_entry_type = &m_callback.target_type();
+}
+
+void Fiber::setEntryType(const std::type_info& type)
+{
+    if (m_entry_type)
+    {
+        m_entry_type = &type;
+    }
+    m_run_entry = &type;
+}
+
+void Fiber::recordStackProfile()
+{
+    m_stack_used = StackProfiler::Scan(m_stack, m_stack_size);
+    StackProfiler::Record(*m_entry_type, m_stack_size, m_stack_used);
+}
+
+// 已分配的协程局部存储槽位数量
+static std::atomic<size_t> s_local_slot_count{0};
+// 各槽位值的析构函数
+static void (*s_local_destructors[Fiber::kLocalSlotCount])(void*) = {};
+
+size_t Fiber::AllocLocalSlot(void (*destructor)(void*))
+{
+    size_t slot = s_local_slot_count++;
+    if (slot >= kLocalSlotCount)
+    {
+        throw Exception("Fiber::AllocLocalSlot 协程局部存储槽位已用尽");
+    }
+    s_local_destructors[slot] = destructor;
+    return slot;
+}
+
+void Fiber::clearLocals()
+{
+    size_t count = std::min<size_t>(s_local_slot_count, kLocalSlotCount);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (m_locals[i])
+        {
+            void* value = m_locals[i];
+            m_locals[i] = nullptr;
+            s_local_destructors[i](value);
+        }
     }
 }
 
 bool Fiber::finish() const noexcept
 {
-    return (m_state == TERM || m_state == EXCEPTION);
+    const State state = getState();
+    return (state == TERM || state == EXCEPTION);
+}
+
+const std::shared_ptr<Fiber::SharedStack>& Fiber::GetSharedStack()
+{
+    static thread_local std::shared_ptr<SharedStack> s_shared_stack(new SharedStack());
+    return s_shared_stack;
 }
 
 Fiber::ptr Fiber::GetThis()
@@ -237,11 +647,41 @@ void Fiber::SetThis(Fiber* fiber)
     FiberInfo::t_fiber = fiber;
 }
 
+// 只有调度器中拥有独立栈的协程可以让出执行权：在调度协程上让出说明通过 Scheduler::scheduleInline
+// 提交的任务试图挂起，在没有协程栈的 master fiber 上让出会在切换上下文时失败
+void Fiber::CheckYieldable()
+{
+    if (InSchedulerFiber())
+    {
+        return;
+    }
+    if (FiberInfo::t_fiber && FiberInfo::t_fiber == Scheduler::GetMainFiber())
+    {
+        throw Exception("通过 Scheduler::scheduleInline 提交的任务不能让出执行权");
+    }
+    throw Exception("只有调度器中的协程可以让出执行权");
+}
+
+bool Fiber::InSchedulerFiber()
+{
+    Fiber* current_fiber = FiberInfo::t_fiber;
+    // 工作线程的 master fiber 就是调度协程；use_caller 的线程在 stop() 之前运行在没有协程栈的 master fiber 上
+    return Scheduler::GetThis() && current_fiber && current_fiber != Scheduler::GetMainFiber() &&
+           current_fiber != FiberInfo::t_master_fiber.get();
+}
+
 void Fiber::Yield()
 {
-    /* FIXME: 可能会造成  shared_ptr 的引用计数只增不减 */
-    Fiber::ptr current_fiber = GetThis();
-    current_fiber->m_state = HOLD;
+    // 直接使用线程局部的裸指针，切换过程中不产生 shared_ptr 引用计数的原子操作
+    Fiber* current_fiber = FiberInfo::t_fiber;
+    assert(current_fiber && "当前线程没有正在执行的协程");
+    // 通过 call() 换入的协程不要求在调度器中，只排除调度协程与没有协程栈的 master fiber，
+    // 这两种情况下 CheckYieldable() 总是抛出对应的 Exception
+    if (current_fiber == Scheduler::GetMainFiber() || current_fiber == FiberInfo::t_master_fiber.get())
+    {
+        CheckYieldable();
+    }
+    current_fiber->setState(HOLD);
     // if (Scheduler::GetThis() && Scheduler::GetThis()->m_root_thread_id == GetThreadID())
     // { // 调度器实例化时 use_caller 为 true, 并且当前协程所在的线程就是 root thread
     //     // current_fiber->swapOut(Scheduler::GetThis()->m_root_fiber);
@@ -256,9 +696,13 @@ void Fiber::Yield()
 
 void Fiber::YieldToHold()
 {
-    /* FIXME: 可能会造成 shared_ptr 的引用计数只增不减 */
-    auto current_fiber = GetThis();
-    current_fiber->m_state = HOLD;
+    // 协程的所有权由调度器的任务或调用者持有，这里只需要裸指针
+    Fiber* current_fiber = FiberInfo::t_fiber;
+    assert(current_fiber && "当前线程没有正在执行的协程");
+    CheckYieldable();
+    // 状态保持 EXEC，由调度器在切换完成后置为 HOLD。
+    // 协程可能在挂起前就已被其他线程重新加入任务队列，调度器不会换入 EXEC 状态的协程，
+    // 这样可以避免在上下文保存完成之前被其他线程换入
     // if (Scheduler::GetThis() && Scheduler::GetThis()->m_root_thread_id == GetThreadID())
     // { // 调度器实例化时 use_caller 为 true, 并且当前协程所在的线程就是 root thread
     //     current_fiber->swapOut(FiberInfo::t_master_fiber);
@@ -270,6 +714,65 @@ void Fiber::YieldToHold()
     current_fiber->swapOut();
 }
 
+bool Fiber::MaybeYield()
+{
+    // 快速路径只读取当前工作线程的抢占标志
+    if (!Scheduler::PreemptRequested())
+    {
+        return false;
+    }
+    Fiber* current_fiber = FiberInfo::t_fiber;
+    if (current_fiber == nullptr || current_fiber == Scheduler::GetMainFiber())
+    {
+        return false;
+    }
+    // READY 状态的协程在切换完成后由调度器重新加入任务队列
+    current_fiber->setState(READY);
+    current_fiber->swapOut();
+    return true;
+}
+
+/**
+ * @brief 线程局部的协程池，缓存执行结束的协程，避免重复分配协程对象、控制块与协程栈
+*/
+static std::vector<Fiber::ptr>& GetFiberPool()
+{
+    static thread_local std::vector<Fiber::ptr> s_fiber_pool;
+    return s_fiber_pool;
+}
+
+Fiber::ptr Fiber::Acquire(FiberFunc callback)
+{
+    auto& pool = GetFiberPool();
+    if (pool.empty())
+    {
+        return std::make_shared<Fiber>(std::move(callback));
+    }
+    Fiber::ptr fiber = std::move(pool.back());
+    pool.pop_back();
+    fiber->reset(std::move(callback));
+    return fiber;
+}
+
+void Fiber::Recycle(Fiber::ptr fiber)
+{
+    if (!fiber || !fiber->finish() || fiber.use_count() != 1 ||
+        fiber->m_shared_stack ||
+        fiber->m_stack_size != ReservedStackSize(FiberInfo::g_fiber_stack_size->getValue()) ||
+        fiber->m_stack_hugepage != FiberInfo::g_stack_hugepage->getValue())
+    {
+        return;
+    }
+    auto& pool = GetFiberPool();
+    if (pool.size() >= FiberInfo::g_fiber_pool_size->getValue())
+    {
+        return;
+    }
+    // 尽早释放执行函数捕获的资源
+    fiber->m_callback = nullptr;
+    pool.push_back(std::move(fiber));
+}
+
 uint64_t Fiber::TotalFiber()
 {
     return FiberInfo::s_fiber_count;
@@ -286,41 +789,51 @@ uint64_t Fiber::GetFiberID()
 
 void Fiber::MainFunc()
 {
-    auto current_fiber = GetThis();
-    auto logger = GET_LOGGER("system");
+    // 协程执行期间由换入它的一方持有所有权，不在协程栈上持有 shared_ptr，
+    // 协程结束后栈上不会残留引用，也不产生引用计数的原子操作
+    Fiber* current_fiber = FiberInfo::t_fiber;
     try
     {
         current_fiber->m_callback();
         current_fiber->m_callback = nullptr;
-        current_fiber->m_state = TERM;
+        current_fiber->setState(TERM);
     }
-    catch (zjl::Exception& e)
+    catch (Exception& e)
     {
+        current_fiber->m_callback = nullptr;
+        current_fiber->setState(EXCEPTION);
         ERROR("Fiber exception: %s, call stack:\n%s",
             e.what(), e.stackTrace());
     }
     catch (std::exception& e)
     {
-        ERROR(logger, "Fiber exception: %s", e.what());
+        current_fiber->m_callback = nullptr;
+        current_fiber->setState(EXCEPTION);
+        ERROR("Fiber exception: %s", e.what());
     }
     catch (...)
     {
-        ERROR(logger, "Fiber exception");
+        current_fiber->m_callback = nullptr;
+        current_fiber->setState(EXCEPTION);
+        ERROR("Fiber exception");
+    }
+    // 协程结束，销毁协程局部存储
+    current_fiber->clearLocals();
+    if (current_fiber->m_entry_type)
+    {
+        current_fiber->recordStackProfile();
     }
     // 执行结束后，切回主协程
-    Fiber* current_fiber_ptr = current_fiber.get();
-    // 释放 shared_ptr 的所有权
-    current_fiber.reset();
     if (Scheduler::GetThis() &&
-        Scheduler::GetThis()->m_root_thread_id == GetThreadID() &&
-        Scheduler::GetThis()->m_root_fiber.get() != current_fiber_ptr)
+        Scheduler::GetThis()->m_root_thread_id == Log::GetThreadId() &&
+        Scheduler::GetThis()->m_root_fiber.get() != current_fiber)
     { // 调度器实例化时 use_caller 为 true, 并且当前协程所在的线程就是 root thread
-        // current_fiber_ptr->swapOut(Scheduler::GetThis()->m_root_fiber);
-        current_fiber_ptr->swapOut();
+        // current_fiber->swapOut(Scheduler::GetThis()->m_root_fiber);
+        current_fiber->swapOut();
     }
     else
     {
-        current_fiber_ptr->back();
+        current_fiber->back();
     }
     assert(false && "协程已经结束");
 }
\ No newline at end of file
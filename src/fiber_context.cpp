@@ -0,0 +1,147 @@
+#include "fiber_context.h"
+
+#if FIBER_USE_ASM_CONTEXT
+
+#include <cstdint>
+#include <cstring>
+
+extern "C" {
+// 新上下文首次被切换进入时的跳板函数，调用保存在 callee-saved 寄存器中的入口函数
+void fiber_context_trampoline();
+}
+
+#if defined(__x86_64__)
+
+/**
+ * x86-64 System V ABI
+ * 保存 rbp rbx r15 r14 r13 r12 以及 MXCSR 与 x87 控制字，栈帧布局（从低地址到高地址）：
+ *   [mxcsr/fpu cw 8 字节][r12][r13][r14][r15][rbx][rbp][返回地址]
+*/
+asm(R"(
+    .text
+    .globl fiber_context_swap
+    .type fiber_context_swap, @function
+    .align 16
+fiber_context_swap:
+    pushq %rbp
+    pushq %rbx
+    pushq %r15
+    pushq %r14
+    pushq %r13
+    pushq %r12
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r12
+    popq %r13
+    popq %r14
+    popq %r15
+    popq %rbx
+    popq %rbp
+    ret
+    .size fiber_context_swap, .-fiber_context_swap
+
+    .globl fiber_context_trampoline
+    .hidden fiber_context_trampoline
+    .type fiber_context_trampoline, @function
+    .align 16
+fiber_context_trampoline:
+    callq *%r12
+    ud2
+    .size fiber_context_trampoline, .-fiber_context_trampoline
+)");
+
+// 初始栈帧的大小与各寄存器槽位的偏移
+static constexpr size_t kFrameSize = 64;
+static constexpr size_t kEntryOffset = 8;      // r12
+static constexpr size_t kReturnOffset = 56;    // 返回地址
+
+static void init_frame(char* frame)
+{
+    // MXCSR 与 x87 控制字使用 ABI 规定的默认值
+    const uint32_t mxcsr = 0x1F80;
+    const uint16_t fpu_cw = 0x037F;
+    std::memcpy(frame, &mxcsr, sizeof(mxcsr));
+    std::memcpy(frame + 4, &fpu_cw, sizeof(fpu_cw));
+}
+
+#elif defined(__aarch64__)
+
+/**
+ * AAPCS64
+ * 保存 d8-d15 x19-x28 x29(fp) x30(lr)，栈帧布局（从低地址到高地址）：
+ *   [d8-d15][x19-x28][x29][x30]
+*/
+asm(R"(
+    .text
+    .globl fiber_context_swap
+    .type fiber_context_swap, %function
+    .align 4
+fiber_context_swap:
+    sub sp, sp, #0xa0
+    stp d8, d9, [sp, #0x00]
+    stp d10, d11, [sp, #0x10]
+    stp d12, d13, [sp, #0x20]
+    stp d14, d15, [sp, #0x30]
+    stp x19, x20, [sp, #0x40]
+    stp x21, x22, [sp, #0x50]
+    stp x23, x24, [sp, #0x60]
+    stp x25, x26, [sp, #0x70]
+    stp x27, x28, [sp, #0x80]
+    stp x29, x30, [sp, #0x90]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0x00]
+    ldp d10, d11, [sp, #0x10]
+    ldp d12, d13, [sp, #0x20]
+    ldp d14, d15, [sp, #0x30]
+    ldp x19, x20, [sp, #0x40]
+    ldp x21, x22, [sp, #0x50]
+    ldp x23, x24, [sp, #0x60]
+    ldp x25, x26, [sp, #0x70]
+    ldp x27, x28, [sp, #0x80]
+    ldp x29, x30, [sp, #0x90]
+    add sp, sp, #0xa0
+    ret
+    .size fiber_context_swap, .-fiber_context_swap
+
+    .globl fiber_context_trampoline
+    .hidden fiber_context_trampoline
+    .type fiber_context_trampoline, %function
+    .align 4
+fiber_context_trampoline:
+    blr x19
+    brk #0
+    .size fiber_context_trampoline, .-fiber_context_trampoline
+)");
+
+static constexpr size_t kFrameSize = 0xa0;
+static constexpr size_t kEntryOffset = 0x40;   // x19
+static constexpr size_t kReturnOffset = 0x98;  // x30
+
+static void init_frame(char* frame)
+{
+}
+
+#endif
+
+void* fiber_context_make(void* stack, size_t size, void (*entry)())
+{
+    // 栈顶按 16 字节对齐
+    uintptr_t top = (reinterpret_cast<uintptr_t>(stack) + size) & ~static_cast<uintptr_t>(15);
+    char* frame = reinterpret_cast<char*>(top - kFrameSize);
+    std::memset(frame, 0, kFrameSize);
+    init_frame(frame);
+    void (*trampoline)() = &fiber_context_trampoline;
+    std::memcpy(frame + kEntryOffset, &entry, sizeof(entry));
+    std::memcpy(frame + kReturnOffset, &trampoline, sizeof(trampoline));
+    return frame;
+}
+
+#endif // FIBER_USE_ASM_CONTEXT
@@ -0,0 +1,155 @@
+#include "fiber_sync.h"
+#include "scheduler.h"
+#include <cassert>
+
+/**
+ * ===============================
+ * FiberWaitQueue 的实现
+ * ===============================
+*/
+
+void FiberWaitQueue::push()
+{
+    // 不能挂起时（包括不在调度器中）在登记等待者之前抛出异常，
+    // 否则唤醒时所有权会交给永远不会运行的调度协程
+    Fiber::CheckYieldable();
+    m_waiters.emplace_back(Scheduler::GetThis(), Fiber::GetThis());
+}
+
+bool FiberWaitQueue::notifyOne()
+{
+    if (m_waiters.empty())
+    {
+        return false;
+    }
+    auto waiter = std::move(m_waiters.front());
+    m_waiters.pop_front();
+    waiter.first->schedule(std::move(waiter.second));
+    return true;
+}
+
+size_t FiberWaitQueue::notifyAll()
+{
+    size_t count = m_waiters.size();
+    while (notifyOne())
+    {
+    }
+    return count;
+}
+
+/**
+ * ===============================
+ * FiberMutex 的实现
+ * ===============================
+*/
+
+void FiberMutex::lock()
+{
+    ScopedLock lock(&m_mutex);
+    if (!m_locked)
+    {
+        m_locked = true;
+        return;
+    }
+    m_waiters.push();
+    lock.unlock();
+    // 被唤醒时锁的所有权已经交给当前协程
+    Fiber::YieldToHold();
+}
+
+bool FiberMutex::tryLock()
+{
+    ScopedLock lock(&m_mutex);
+    if (m_locked)
+    {
+        return false;
+    }
+    m_locked = true;
+    return true;
+}
+
+void FiberMutex::unlock()
+{
+    ScopedLock lock(&m_mutex);
+    assert(m_locked);
+    // 存在等待者时不释放锁，直接把所有权交给下一个协程
+    if (!m_waiters.notifyOne())
+    {
+        m_locked = false;
+    }
+}
+
+/**
+ * ===============================
+ * FiberCondition 的实现
+ * ===============================
+*/
+
+void FiberCondition::wait(FiberMutex& mutex)
+{
+    {
+        ScopedLock lock(&m_mutex);
+        m_waiters.push();
+    }
+    // 先加入等待队列再释放 mutex，notify 不会丢失
+    mutex.unlock();
+    Fiber::YieldToHold();
+    mutex.lock();
+}
+
+void FiberCondition::notifyOne()
+{
+    ScopedLock lock(&m_mutex);
+    m_waiters.notifyOne();
+}
+
+void FiberCondition::notifyAll()
+{
+    ScopedLock lock(&m_mutex);
+    m_waiters.notifyAll();
+}
+
+/**
+ * ===============================
+ * FiberSemaphore 的实现
+ * ===============================
+*/
+
+FiberSemaphore::FiberSemaphore(size_t count)
+    : m_count(count)
+{
+}
+
+void FiberSemaphore::wait()
+{
+    ScopedLock lock(&m_mutex);
+    if (m_count > 0)
+    {
+        --m_count;
+        return;
+    }
+    m_waiters.push();
+    lock.unlock();
+    // 被唤醒时 notify 已经把计数直接交给当前协程
+    Fiber::YieldToHold();
+}
+
+bool FiberSemaphore::tryWait()
+{
+    ScopedLock lock(&m_mutex);
+    if (m_count > 0)
+    {
+        --m_count;
+        return true;
+    }
+    return false;
+}
+
+void FiberSemaphore::notify()
+{
+    ScopedLock lock(&m_mutex);
+    if (!m_waiters.notifyOne())
+    {
+        ++m_count;
+    }
+}
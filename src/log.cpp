@@ -680,7 +680,7 @@ namespace Log {
 
     void __log(const string& file, int line, int level, const char* fmt, ...) {
 
-        if(level > __g_logger.logger_level)
+        if(level < __g_logger.logger_level)
             return;
 
         string now = time_now();
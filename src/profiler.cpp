@@ -0,0 +1,304 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <sstream>
+
+/**
+ * ===============================
+ * Log2Histogram 的实现
+ * ===============================
+*/
+
+// 样本所在的桶：值的二进制位数
+static size_t BucketIndex(uint64_t value)
+{
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+// 桶的上界
+static uint64_t BucketUpper(size_t index)
+{
+    return index == 0 ? 0 : (index >= 64 ? ~0ull : (1ull << index) - 1);
+}
+
+void Log2Histogram::add(uint64_t value)
+{
+    size_t index = BucketIndex(value);
+    if (index >= kBucketCount)
+    {
+        index = kBucketCount - 1;
+    }
+    ++m_buckets[index];
+    ++m_count;
+    m_sum += value;
+    if (value > m_max)
+    {
+        m_max = value;
+    }
+}
+
+void Log2Histogram::merge(const Log2Histogram& rhs)
+{
+    for (size_t i = 0; i < kBucketCount; ++i)
+    {
+        m_buckets[i] += rhs.m_buckets[i];
+    }
+    m_count += rhs.m_count;
+    m_sum += rhs.m_sum;
+    if (rhs.m_max > m_max)
+    {
+        m_max = rhs.m_max;
+    }
+}
+
+uint64_t Log2Histogram::percentile(double percent) const
+{
+    if (m_count == 0)
+    {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(m_count * percent / 100.0);
+    if (target >= m_count)
+    {
+        target = m_count - 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen > target)
+        {
+            return std::min(BucketUpper(i), m_max);
+        }
+    }
+    return m_max;
+}
+
+std::string Log2Histogram::toString(const char* unit) const
+{
+    std::stringstream ss;
+    ss << "count=" << m_count
+       << " avg=" << (m_count ? m_sum / m_count : 0) << unit
+       << " p50=" << percentile(50) << unit
+       << " p99=" << percentile(99) << unit
+       << " max=" << m_max << unit;
+    for (size_t i = 0; i < kBucketCount; ++i)
+    {
+        if (m_buckets[i])
+        {
+            ss << "\n    <= " << BucketUpper(i) << unit << ": " << m_buckets[i];
+        }
+    }
+    return ss.str();
+}
+
+void AtomicLog2Histogram::add(uint64_t value)
+{
+    size_t index = BucketIndex(value);
+    if (index >= Log2Histogram::kBucketCount)
+    {
+        index = Log2Histogram::kBucketCount - 1;
+    }
+    m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (value > max &&
+           !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void AtomicLog2Histogram::mergeInto(Log2Histogram& out) const
+{
+    for (size_t i = 0; i < Log2Histogram::kBucketCount; ++i)
+    {
+        out.m_buckets[i] += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    out.m_count += m_count.load(std::memory_order_relaxed);
+    out.m_sum += m_sum.load(std::memory_order_relaxed);
+    out.m_max = std::max(out.m_max, m_max.load(std::memory_order_relaxed));
+}
+
+std::string DemangleTypeName(const char* mangled)
+{
+    int status = 0;
+    char* name = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+    if (status != 0 || name == nullptr)
+    {
+        return mangled;
+    }
+    std::string result(name);
+    ::free(name);
+    return result;
+}
+
+std::string DemangleTypeName(const std::type_info& type)
+{
+    return DemangleTypeName(type.name());
+}
+
+/**
+ * ===============================
+ * StackProfiler 的实现
+ * ===============================
+*/
+
+// 栈填充模式
+static const uint64_t kStackCanary = 0xA5A5A5A5A5A5A5A5ull;
+
+void StackProfiler::Fill(void* stack, size_t size)
+{
+    ::memset(stack, static_cast<int>(kStackCanary & 0xFF), size);
+}
+
+size_t StackProfiler::Scan(const void* stack, size_t size)
+{
+    // 栈从高地址向低地址增长，从栈底（低地址）向上找到第一个被改写的字
+    const uint64_t* begin = static_cast<const uint64_t*>(stack);
+    const uint64_t* end = begin + size / sizeof(uint64_t);
+    const uint64_t* it = begin;
+    while (it != end && *it == kStackCanary)
+    {
+        ++it;
+    }
+    return (end - it) * sizeof(uint64_t);
+}
+
+void StackProfiler::Record(const std::type_info& entry, size_t stack_size, size_t used)
+{
+    std::string name = DemangleTypeName(entry);
+    ScopedLock lock(&GetMutex());
+    Entry& item = GetEntries()[name];
+    item.stack_size = stack_size;
+    item.histogram.add(used);
+}
+
+std::string StackProfiler::Report()
+{
+    ScopedLock lock(&GetMutex());
+    std::stringstream ss;
+    for (const auto& item : GetEntries())
+    {
+        ss << item.first << " (stack_size=" << item.second.stack_size << "B)\n  "
+           << item.second.histogram.toString("B") << "\n";
+    }
+    return ss.str();
+}
+
+void StackProfiler::Clear()
+{
+    ScopedLock lock(&GetMutex());
+    GetEntries().clear();
+}
+
+Mutex& StackProfiler::GetMutex()
+{
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+std::map<std::string, StackProfiler::Entry>& StackProfiler::GetEntries()
+{
+    static std::map<std::string, Entry> s_entries;
+    return s_entries;
+}
+
+/**
+ * ===============================
+ * FiberAccounting 的实现
+ * ===============================
+*/
+
+void FiberAccounting::RecordFiber(const std::type_info& entry, uint64_t run_ns, uint64_t switches)
+{
+    Shard& shard = GetShard();
+    ScopedLock lock(&shard.mutex);
+    Stats& stats = shard.stats[std::type_index(entry)];
+    stats.run_ns.add(run_ns);
+    stats.switches.add(switches);
+}
+
+void FiberAccounting::RecordWait(const std::type_info& entry, uint64_t wait_ns)
+{
+    Shard& shard = GetShard();
+    ScopedLock lock(&shard.mutex);
+    shard.stats[std::type_index(entry)].wait_ns.add(wait_ns);
+}
+
+std::map<std::string, FiberAccounting::Stats> FiberAccounting::Snapshot()
+{
+    std::vector<std::shared_ptr<Shard>> shards;
+    {
+        ScopedLock lock(&GetMutex());
+        shards = GetShards();
+    }
+    std::unordered_map<std::type_index, Stats> merged;
+    for (auto& shard : shards)
+    {
+        ScopedLock lock(&shard->mutex);
+        for (const auto& item : shard->stats)
+        {
+            Stats& stats = merged[item.first];
+            stats.run_ns.merge(item.second.run_ns);
+            stats.switches.merge(item.second.switches);
+            stats.wait_ns.merge(item.second.wait_ns);
+        }
+    }
+    std::map<std::string, Stats> result;
+    for (auto& item : merged)
+    {
+        result[DemangleTypeName(item.first.name())] = std::move(item.second);
+    }
+    return result;
+}
+
+std::string FiberAccounting::Report()
+{
+    std::stringstream ss;
+    for (const auto& item : Snapshot())
+    {
+        ss << item.first
+           << "\n  run:      " << item.second.run_ns.toString("ns")
+           << "\n  switches: " << item.second.switches.toString("")
+           << "\n  wait:     " << item.second.wait_ns.toString("ns") << "\n";
+    }
+    return ss.str();
+}
+
+void FiberAccounting::Clear()
+{
+    ScopedLock lock(&GetMutex());
+    for (auto& shard : GetShards())
+    {
+        ScopedLock shard_lock(&shard->mutex);
+        shard->stats.clear();
+    }
+}
+
+FiberAccounting::Shard& FiberAccounting::GetShard()
+{
+    // 线程退出后统计数据仍由全局列表持有
+    static thread_local std::shared_ptr<Shard> s_shard;
+    if (!s_shard)
+    {
+        s_shard = std::make_shared<Shard>();
+        ScopedLock lock(&GetMutex());
+        GetShards().push_back(s_shard);
+    }
+    return *s_shard;
+}
+
+Mutex& FiberAccounting::GetMutex()
+{
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+std::vector<std::shared_ptr<FiberAccounting::Shard>>& FiberAccounting::GetShards()
+{
+    static std::vector<std::shared_ptr<Shard>> s_shards;
+    return s_shards;
+}
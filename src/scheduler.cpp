@@ -0,0 +1,1406 @@
+#include "scheduler.h"
+#include "exception.h"
+#include "log.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// 当前线程所属的调度器
+static thread_local Scheduler* t_scheduler = nullptr;
+// 当前线程负责调度的协程
+static thread_local Fiber* t_scheduler_fiber = nullptr;
+// 当前线程的任务队列下标，-1 表示不是工作线程
+static thread_local long t_worker_index = -1;
+// 工作线程连续执行多少次本地任务后检查一次全局队列，避免外部提交的任务饥饿
+static constexpr uint64_t kGlobalCheckInterval = 61;
+// 任务节点在线程局部节点池与全局节点池之间成批移动的数量
+static constexpr size_t kTaskCacheBatch = 64;
+// 线程局部节点池缓存的节点上限
+static constexpr size_t kTaskCacheMax = 4 * kTaskCacheBatch;
+// 全局节点池缓存的节点上限
+static constexpr size_t kTaskPoolMax = 64 * kTaskCacheBatch;
+
+// 休眠的工作线程最长休眠时间，超时后重新检查停止状态
+static constexpr long kParkTimeoutNS = 100 * 1000 * 1000;
+
+static void FutexWait(std::atomic<uint32_t>* addr, uint32_t expected, const timespec* timeout)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected,
+              timeout, nullptr, 0);
+}
+
+static void FutexWake(std::atomic<uint32_t>* addr)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, 1,
+              nullptr, nullptr, 0);
+}
+
+// 自旋等待时降低 CPU 功耗，并让出超线程的执行资源
+static inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/**
+ * @brief 休眠中的工作线程，位于休眠线程的协程栈上
+ * state 由 0 变为 1 表示已被唤醒，唤醒者在持有 m_park_mutex 时修改 state 并执行 futex 唤醒
+*/
+struct Scheduler::Parker
+{
+    std::atomic<uint32_t> state{0};
+    long thread_id = -1;
+    Parker* next = nullptr;
+};
+
+/**
+ * @brief 任务节点池
+ * 每个线程缓存一批空闲节点，本地为空时从全局节点池成批取回，超过上限时成批归还全局节点池。
+ * 任务通常在一个线程上提交、在另一个线程上执行结束并回收，节点经由全局节点池流回提交线程，
+ * 稳定状态下不需要分配内存
+*/
+struct Scheduler::Task::Cache
+{
+    Task* head = nullptr;
+    size_t count = 0;
+
+    ~Cache()
+    {
+        while (head)
+        {
+            delete pop();
+        }
+    }
+
+    void push(Task* task)
+    {
+        task->next = head;
+        head = task;
+        ++count;
+    }
+
+    Task* pop()
+    {
+        Task* task = head;
+        head = task->next;
+        task->next = nullptr;
+        --count;
+        return task;
+    }
+
+    // 从 other 中移动最多 n 个节点
+    void transfer(Cache& other, size_t n)
+    {
+        while (n-- > 0 && other.head)
+        {
+            push(other.pop());
+        }
+    }
+
+    static Cache& Local()
+    {
+        static thread_local Cache s_cache;
+        return s_cache;
+    }
+
+    static Cache& Global()
+    {
+        static Cache s_cache;
+        return s_cache;
+    }
+
+    static Mutex& GlobalMutex()
+    {
+        static Mutex s_mutex;
+        return s_mutex;
+    }
+};
+
+Scheduler::Task* Scheduler::Task::Alloc()
+{
+    Cache& local = Cache::Local();
+    if (local.head == nullptr)
+    {
+        ScopedLock lock(&Cache::GlobalMutex());
+        local.transfer(Cache::Global(), kTaskCacheBatch);
+    }
+    if (local.head == nullptr)
+    {
+        return new Task();
+    }
+    return local.pop();
+}
+
+void Scheduler::Task::Destroy(Task* task)
+{
+    task->fiber = nullptr;
+    task->callback = nullptr;
+    task->thread_id = -1;
+    task->priority = NORMAL;
+    task->deadline_ns = 0;
+    task->run_inline = false;
+    task->enqueue_ns = 0;
+    Cache& local = Cache::Local();
+    local.push(task);
+    if (local.count > kTaskCacheMax)
+    {
+        Cache& global = Cache::Global();
+        ScopedLock lock(&Cache::GlobalMutex());
+        global.transfer(local, kTaskCacheBatch);
+        while (global.count > kTaskPoolMax)
+        {
+            delete global.pop();
+        }
+    }
+}
+
+Scheduler::Scheduler(size_t thread_size, bool use_caller, std::string name)
+    : Scheduler(thread_size, thread_size, use_caller, std::move(name))
+{
+}
+
+Scheduler::Scheduler(size_t min_threads, size_t max_threads, bool use_caller, std::string name)
+    : m_name(std::move(name)),
+      m_work_stealing(SchedulerInfo::g_work_stealing->getValue()),
+      m_metrics(SchedulerInfo::g_metrics->getValue()),
+      m_watchdog_budget_ns(SchedulerInfo::g_watchdog_budget_ms->getValue() * 1000000),
+      m_time_slice_ns(SchedulerInfo::g_time_slice_ms->getValue() * 1000000),
+      m_monitor_interval_ms(std::max<uint64_t>(SchedulerInfo::g_watchdog_interval_ms->getValue(), 1)),
+      m_grow_wait_ns(SchedulerInfo::g_elastic_grow_wait_us->getValue() * 1000),
+      m_retire_idle_ns(SchedulerInfo::g_elastic_retire_idle_ms->getValue() * 1000000)
+{
+    assert(min_threads > 0 && min_threads <= max_threads);
+    size_t thread_size = min_threads;
+    // 每个可能参与调度的线程（包括 use_caller 时的当前线程）一个任务队列，弹性模式下按上限分配
+    m_workers.reserve(max_threads);
+    for (size_t i = 0; i < max_threads; ++i)
+    {
+        m_workers.emplace_back(new Worker());
+        m_workers.back()->random_state = i * 0x9E3779B97F4A7C15ull + 1;
+    }
+    if (use_caller)
+    {
+        // 在当前线程上创建 master fiber
+        Fiber::GetThis();
+        // 当前线程也参与调度，需要创建的线程数量减一
+        --thread_size;
+        // 一个线程只能有一个调度器
+        assert(GetThis() == nullptr);
+        t_scheduler = this;
+        // 调度协程运行 run()，在 stop() 时由 master fiber 换入
+        m_root_fiber.reset(new Fiber(std::bind(&Scheduler::run, this)));
+        Thread::SetThisThreadName(m_name);
+        t_scheduler_fiber = m_root_fiber.get();
+        m_root_thread_id = Log::GetThreadId();
+        m_thread_id_list.push_back(m_root_thread_id);
+    }
+    else
+    {
+        m_root_thread_id = -1;
+    }
+    m_thread_count = thread_size;
+    m_max_thread_count = thread_size + (max_threads - min_threads);
+    if (m_max_thread_count > m_thread_count)
+    {
+        // 弹性模式根据排队等待时间增加线程，需要记录等待时间与空闲时间
+        m_metrics = true;
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    assert(m_stopping);
+    for (auto& queue : m_queues)
+    {
+        while (queue.head)
+        {
+            Task* task = queue.head;
+            queue.head = task->next;
+            Task::Destroy(task);
+        }
+        for (Task* task : queue.deadlines)
+        {
+            Task::Destroy(task);
+        }
+    }
+    if (GetThis() == this)
+    {
+        t_scheduler = nullptr;
+    }
+}
+
+Scheduler* Scheduler::GetThis()
+{
+    return t_scheduler;
+}
+
+Fiber* Scheduler::GetMainFiber()
+{
+    return t_scheduler_fiber;
+}
+
+void Scheduler::start()
+{
+    ScopedLock lock(&m_mutex);
+    if (!m_stopping)
+    {
+        return;
+    }
+    m_stopping = false;
+    assert(m_thread_list.empty());
+    // 低下标的槽位先被使用
+    m_free_workers.clear();
+    for (size_t i = m_workers.size(); i > 0; --i)
+    {
+        m_free_workers.push_back(i - 1);
+    }
+    m_live_threads = m_thread_count;
+    m_retiring_threads = 0;
+    m_spawned_threads = m_thread_count;
+    m_retired_threads.clear();
+    m_thread_list.resize(m_thread_count);
+    for (size_t i = 0; i < m_thread_count; ++i)
+    {
+        m_thread_list[i] = std::make_shared<Thread>(
+            std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i));
+        m_thread_id_list.push_back(m_thread_list[i]->getId());
+    }
+    if (m_watchdog_budget_ns != 0 || m_max_thread_count > m_thread_count)
+    {
+        {
+            ScopedLock monitor_lock(&m_monitor_mutex);
+            m_monitor_stopping = false;
+        }
+        m_sample_wait_sum = 0;
+        m_sample_wait_count = 0;
+        m_sample_ns = FiberAccounting::Now();
+        m_grow_streak = 0;
+        m_monitor_thread = std::make_shared<Thread>(std::bind(&Scheduler::monitorMain, this),
+                                                    m_name + "_monitor");
+    }
+}
+
+void Scheduler::stop()
+{
+    m_auto_stop = true;
+    // 先停止监控线程，停止过程中不再增加工作线程
+    stopMonitor();
+    // 只有调度协程，并且调度协程未启动或者已经结束
+    if (m_root_fiber && m_max_thread_count == 0 &&
+        (m_root_fiber->finish() || m_root_fiber->getState() == Fiber::INIT))
+    {
+        m_stopping = true;
+        if (onStop())
+        {
+            return;
+        }
+    }
+    m_stopping = true;
+    // 唤醒所有线程，让它们检查停止状态
+    unpark(-1, true);
+    if (m_root_fiber)
+    {
+        // 当前线程也参与调度，执行完剩余的任务再返回
+        if (!onStop())
+        {
+            m_root_fiber->call();
+        }
+    }
+    std::vector<Thread::ptr> threads;
+    {
+        ScopedLock lock(&m_mutex);
+        threads.swap(m_thread_list);
+    }
+    for (auto& thread : threads)
+    {
+        thread->join();
+    }
+}
+
+bool Scheduler::isStop()
+{
+    ScopedLock lock(&m_mutex);
+    if (!(m_auto_stop && m_stopping && m_global_task_count == 0))
+    {
+        return false;
+    }
+    // 其他线程取出任务后才写入 active 标志，这里可能读到旧值；取出任务的线程会自己执行它，
+    // 本线程提前结束调度不会丢失任务
+    for (auto& worker : m_workers)
+    {
+        if (worker->stats.active.load(std::memory_order_relaxed) != 0 ||
+            !worker->deque.empty() || !worker->inbox.empty())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Scheduler::tickle()
+{
+    unpark(-1, false);
+}
+
+void Scheduler::onIdle()
+{
+    while (!isStop())
+    {
+        // 先短暂自旋，任务很快到来时避免休眠与唤醒的系统调用
+        const uint64_t spin = SchedulerInfo::g_idle_spin->getValue();
+        bool pending = false;
+        for (uint64_t i = 0; i < spin && !pending; ++i)
+        {
+            CpuRelax();
+            pending = hasPendingTask();
+        }
+        if (!pending)
+        {
+            park();
+            if (tryRetire())
+            {
+                // 空闲协程结束，run() 随后退出本线程
+                return;
+            }
+        }
+        Fiber::YieldToHold();
+    }
+}
+
+bool Scheduler::hasPendingTask()
+{
+    Worker* self = localWorker();
+    if (self && !self->inbox.empty())
+    {
+        return true;
+    }
+    for (auto& worker : m_workers)
+    {
+        if (!worker->deque.empty())
+        {
+            return true;
+        }
+    }
+    if (m_global_task_count.load() == 0)
+    {
+        return false;
+    }
+    // 全局队列中可能只有绑定其他线程的任务或者正在其他线程上切换的协程
+    ScopedLock lock(&m_mutex);
+    for (auto& queue : m_queues)
+    {
+        for (Task* task = queue.head; task != nullptr; task = task->next)
+        {
+            if (Runnable(task))
+            {
+                return true;
+            }
+        }
+        for (Task* task : queue.deadlines)
+        {
+            if (Runnable(task))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Scheduler::park()
+{
+    localStats().parks.fetch_add(1, std::memory_order_relaxed);
+    Parker parker;
+    parker.thread_id = Log::GetThreadId();
+    {
+        ScopedLock lock(&m_park_mutex);
+        parker.next = m_parked;
+        m_parked = &parker;
+        ++m_parked_count;
+    }
+    // 先登记休眠再检查任务与停止状态，与提交任务（或结束最后一个任务）后检查休眠数量的顺序相对，
+    // 保证不会错过唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!hasPendingTask() && !isStop())
+    {
+        timespec timeout = {0, kParkTimeoutNS};
+        FutexWait(&parker.state, 0, &timeout);
+    }
+    ScopedLock lock(&m_park_mutex);
+    // 超时或者没有休眠时，由自己从链表中移除；被唤醒时唤醒者已经移除
+    if (parker.state.load() == 0)
+    {
+        Parker** link = &m_parked;
+        while (*link != &parker)
+        {
+            link = &(*link)->next;
+        }
+        *link = parker.next;
+        --m_parked_count;
+    }
+}
+
+void Scheduler::unpark(long thread_id, bool all)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_parked_count.load() == 0)
+    {
+        return;
+    }
+    Stats& stats = localStats();
+    ScopedLock lock(&m_park_mutex);
+    Parker** link = &m_parked;
+    while (*link != nullptr)
+    {
+        Parker* parker = *link;
+        if (thread_id != -1 && parker->thread_id != thread_id)
+        {
+            link = &parker->next;
+            continue;
+        }
+        *link = parker->next;
+        --m_parked_count;
+        parker->state.store(1);
+        FutexWake(&parker->state);
+        stats.unparks.fetch_add(1, std::memory_order_relaxed);
+        if (!all)
+        {
+            break;
+        }
+    }
+}
+
+Scheduler::Worker::~Worker()
+{
+    Task* task = nullptr;
+    while (deque.pop(task))
+    {
+        Task::Destroy(task);
+    }
+    while ((task = inbox.pop()) != nullptr)
+    {
+        Task::Destroy(task);
+    }
+}
+
+Scheduler::Worker* Scheduler::localWorker()
+{
+    if (t_scheduler != this || t_worker_index < 0)
+    {
+        return nullptr;
+    }
+    return m_workers[t_worker_index].get();
+}
+
+// 结束一个从 since 开始的时间段，累加到 total
+static void EndPeriod(std::atomic<uint64_t>& since, std::atomic<uint64_t>& total, uint64_t now)
+{
+    const uint64_t begin = since.exchange(0, std::memory_order_relaxed);
+    if (begin != 0)
+    {
+        total.fetch_add(now - begin, std::memory_order_relaxed);
+    }
+}
+
+// 已经结束的时间段与进行中的时间段之和
+static uint64_t PeriodTotal(const std::atomic<uint64_t>& since, const std::atomic<uint64_t>& total,
+                            uint64_t now)
+{
+    const uint64_t begin = since.load(std::memory_order_relaxed);
+    return total.load(std::memory_order_relaxed) + (begin != 0 && now > begin ? now - begin : 0);
+}
+
+void Scheduler::beginRun(Worker* worker, uint64_t now, uint64_t fiber_id,
+                         const std::type_info& entry)
+{
+    if (m_watchdog_budget_ns == 0)
+    {
+        return;
+    }
+    RunSlot& run = worker->run;
+    run.preempt.store(false, std::memory_order_relaxed);
+    run.fiber_id.store(fiber_id, std::memory_order_relaxed);
+    run.entry.store(&entry, std::memory_order_relaxed);
+    run.seq.store(run.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    // 最后写入开始时间，watchdog 看到开始时间时其他字段已经更新
+    run.since.store(now, std::memory_order_release);
+}
+
+void Scheduler::endRun(Worker* worker)
+{
+    if (m_watchdog_budget_ns != 0)
+    {
+        worker->run.since.store(0, std::memory_order_release);
+    }
+}
+
+bool Scheduler::PreemptRequested()
+{
+    Scheduler* scheduler = t_scheduler;
+    Worker* worker = scheduler ? scheduler->localWorker() : nullptr;
+    if (worker == nullptr)
+    {
+        return false;
+    }
+    std::atomic<bool>& preempt = worker->run.preempt;
+    return preempt.load(std::memory_order_relaxed) &&
+           preempt.exchange(false, std::memory_order_relaxed);
+}
+
+void Scheduler::monitorMain()
+{
+    ScopedLock lock(&m_monitor_mutex);
+    while (!m_monitor_stopping)
+    {
+        m_monitor_cond.waitFor(m_monitor_mutex, m_monitor_interval_ms);
+        if (m_monitor_stopping)
+        {
+            break;
+        }
+        lock.unlock();
+        if (m_watchdog_budget_ns != 0)
+        {
+            checkLongRuns();
+        }
+        if (m_max_thread_count > m_thread_count)
+        {
+            adjustWorkers(FiberAccounting::Now());
+        }
+        lock.lock();
+    }
+}
+
+void Scheduler::checkLongRuns()
+{
+    const uint64_t now = FiberAccounting::Now();
+    for (auto& worker : m_workers)
+    {
+        RunSlot& run = worker->run;
+        const uint64_t since = run.since.load(std::memory_order_acquire);
+        if (since == 0 || now <= since)
+        {
+            continue;
+        }
+        const uint64_t elapsed = now - since;
+        if (elapsed >= m_time_slice_ns)
+        {
+            run.preempt.store(true, std::memory_order_relaxed);
+        }
+        if (elapsed < m_watchdog_budget_ns)
+        {
+            continue;
+        }
+        const uint64_t seq = run.seq.load(std::memory_order_relaxed);
+        const uint64_t fiber_id = run.fiber_id.load(std::memory_order_relaxed);
+        const std::type_info* entry = run.entry.load(std::memory_order_relaxed);
+        // 同一次运行在之后的采样中只更新最长运行时间
+        const bool first = (seq != worker->reported_seq);
+        worker->reported_seq = seq;
+        {
+            ScopedLock lock(&m_monitor_mutex);
+            LongRun& record = m_long_runs[std::type_index(*entry)];
+            if (first)
+            {
+                ++record.count;
+                record.fiber_id = fiber_id;
+            }
+            record.max_ns = std::max(record.max_ns, elapsed);
+        }
+        if (first)
+        {
+            WARN("Scheduler %s: 线程 %ld 上的协程 %lu 已经连续运行 %lu ms，超过预算 %lu ms，入口函数 %s",
+                 m_name.c_str(), worker->thread_id.load(std::memory_order_relaxed), fiber_id,
+                 elapsed / 1000000, m_watchdog_budget_ns / 1000000, DemangleTypeName(*entry).c_str());
+        }
+    }
+}
+
+void Scheduler::stopMonitor()
+{
+    Thread::ptr thread;
+    {
+        ScopedLock lock(&m_monitor_mutex);
+        m_monitor_stopping = true;
+        m_monitor_cond.notifyAll();
+        thread.swap(m_monitor_thread);
+    }
+    if (thread)
+    {
+        thread->join();
+    }
+}
+
+void Scheduler::adjustWorkers(uint64_t now)
+{
+    // 采样窗口内被取出的任务的平均排队等待时间
+    uint64_t wait_sum = 0;
+    uint64_t wait_count = 0;
+    size_t pending = m_global_task_count.load(std::memory_order_relaxed);
+    for (auto& worker : m_workers)
+    {
+        wait_sum += worker->stats.wait_ns.sum();
+        wait_count += worker->stats.wait_ns.count();
+        pending += worker->deque.size() + worker->inbox.size();
+    }
+    const uint64_t window_count = wait_count - m_sample_wait_count;
+    uint64_t wait_ns = window_count ? (wait_sum - m_sample_wait_sum) / window_count : 0;
+    if (window_count == 0 && pending > 0)
+    {
+        // 有任务排队但整个窗口内没有任务被取出：所有线程都被占用
+        wait_ns = now - m_sample_ns;
+    }
+    m_sample_wait_sum = wait_sum;
+    m_sample_wait_count = wait_count;
+    m_sample_ns = now;
+    // 有空闲线程时排队来自瞬时的突发，增加线程没有帮助
+    if (wait_ns < m_grow_wait_ns || pending == 0 || m_idle_thread_count.load() != 0)
+    {
+        m_grow_streak = 0;
+        return;
+    }
+    // 连续两次采样超过阈值才增加线程，每次最多增加一个
+    if (++m_grow_streak >= 2)
+    {
+        m_grow_streak = 0;
+        spawnWorker();
+    }
+}
+
+void Scheduler::spawnWorker()
+{
+    std::vector<Thread::ptr> retired;
+    {
+        ScopedLock lock(&m_mutex);
+        if (m_stopping || m_live_threads.load() >= m_max_thread_count)
+        {
+            return;
+        }
+        // 回收已经退出的线程，线程列表的长度不随线程的增减而增长
+        for (long thread_id : m_retired_threads)
+        {
+            for (auto it = m_thread_list.begin(); it != m_thread_list.end(); ++it)
+            {
+                if ((*it)->getId() == thread_id)
+                {
+                    retired.push_back(std::move(*it));
+                    m_thread_list.erase(it);
+                    break;
+                }
+            }
+            m_thread_id_list.erase(
+                std::remove(m_thread_id_list.begin(), m_thread_id_list.end(), thread_id),
+                m_thread_id_list.end());
+        }
+        m_retired_threads.clear();
+        ++m_live_threads;
+        m_last_grow_ns.store(FiberAccounting::Now(), std::memory_order_relaxed);
+        m_thread_list.push_back(std::make_shared<Thread>(
+            std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(m_spawned_threads++)));
+        m_thread_id_list.push_back(m_thread_list.back()->getId());
+        VERBOSE("Scheduler %s: 排队等待时间过长，增加工作线程，当前线程数 %zu", m_name.c_str(),
+                m_live_threads.load());
+    }
+    for (auto& thread : retired)
+    {
+        thread->join();
+    }
+}
+
+bool Scheduler::tryRetire()
+{
+    if (m_max_thread_count == m_thread_count || Log::GetThreadId() == m_root_thread_id)
+    {
+        return false;
+    }
+    Worker* worker = localWorker();
+    const uint64_t now = FiberAccounting::Now();
+    if (worker == nullptr || worker->idle_streak_since == 0 ||
+        now - worker->idle_streak_since < m_retire_idle_ns ||
+        now - m_last_grow_ns.load(std::memory_order_relaxed) < m_retire_idle_ns)
+    {
+        return false;
+    }
+    // 线程数量直到 releaseWorker 归还槽位时才扣除，期间 spawnWorker 不会创建没有槽位可用的线程
+    ScopedLock lock(&m_mutex);
+    if (m_live_threads.load() - m_retiring_threads <= m_thread_count)
+    {
+        return false;
+    }
+    ++m_retiring_threads;
+    worker->retiring = true;
+    return true;
+}
+
+void Scheduler::releaseWorker(Worker* worker)
+{
+    size_t moved = 0;
+    {
+        ScopedLock lock(&m_mutex);
+        // 先注销线程 id 再取出收件箱：与 scheduleInbox 中加入之后的检查配对，
+        // 查找到本线程之后才加入的任务，要么在这里被取出，要么由生产者发现本线程已经退出
+        worker->thread_id.store(-1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // 退出前最后一刻加入的任务交给其他线程，绑定本线程的任务不再绑定
+        Task* task = nullptr;
+        while ((task = worker->inbox.pop()) != nullptr || worker->deque.pop(task))
+        {
+            task->thread_id = -1;
+            pushGlobalTask(task, false);
+            ++moved;
+        }
+        if (worker->retiring)
+        {
+            // 扣除线程数量与归还槽位在同一临界区内，spawnWorker 看到的线程数量总有槽位可用
+            --m_retiring_threads;
+            --m_live_threads;
+            m_free_workers.push_back(static_cast<size_t>(t_worker_index));
+            m_retired_threads.push_back(Log::GetThreadId());
+        }
+    }
+    while (moved-- > 0)
+    {
+        tickle();
+    }
+    if (worker->retiring)
+    {
+        VERBOSE("Scheduler %s: 工作线程长时间空闲，退出，当前线程数 %zu", m_name.c_str(),
+                m_live_threads.load());
+    }
+}
+
+size_t Scheduler::claimWorker()
+{
+    ScopedLock lock(&m_mutex);
+    assert(!m_free_workers.empty());
+    const size_t index = m_free_workers.back();
+    m_free_workers.pop_back();
+    // 在临界区内登记线程 id，rescueInbox 看到 -1 时槽位一定没有线程在取收件箱
+    m_workers[index]->thread_id.store(Log::GetThreadId(), std::memory_order_release);
+    return index;
+}
+
+std::vector<Scheduler::LongRun> Scheduler::getLongRuns() const
+{
+    std::vector<LongRun> result;
+    {
+        ScopedLock lock(&m_monitor_mutex);
+        result.reserve(m_long_runs.size());
+        for (auto& item : m_long_runs)
+        {
+            result.push_back(item.second);
+            result.back().entry = DemangleTypeName(item.first.name());
+        }
+    }
+    std::sort(result.begin(), result.end(),
+              [](const LongRun& lhs, const LongRun& rhs) { return lhs.count > rhs.count; });
+    return result;
+}
+
+// 只由一个线程写入的计数器加一：读取加一再写回，不需要原子的读改写指令
+static inline void IncrementOwned(std::atomic<uint64_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+Scheduler::Stats& Scheduler::localStats()
+{
+    Worker* worker = localWorker();
+    return worker ? worker->stats : m_external_stats;
+}
+
+void Scheduler::onEnqueue(Task* task)
+{
+    Worker* worker = localWorker();
+    if (worker)
+    {
+        IncrementOwned(worker->stats.submitted);
+    }
+    else
+    {
+        // 外部线程共用一份统计数据
+        m_external_stats.submitted.fetch_add(1, std::memory_order_relaxed);
+    }
+#ifdef FIBER_ACCOUNTING
+    task->enqueue_ns = FiberAccounting::Now();
+#else
+    task->enqueue_ns = m_metrics ? FiberAccounting::Now() : 0;
+#endif
+}
+
+Scheduler::Metrics Scheduler::getMetrics() const
+{
+    Metrics metrics;
+    const uint64_t now = FiberAccounting::Now();
+    metrics.submitted = m_external_stats.submitted.load(std::memory_order_relaxed);
+    metrics.unparks = m_external_stats.unparks.load(std::memory_order_relaxed);
+    metrics.global_queue_depth = m_global_task_count.load(std::memory_order_relaxed);
+    metrics.queue_depth = metrics.global_queue_depth;
+    metrics.idle_threads = m_idle_thread_count.load(std::memory_order_relaxed);
+    metrics.workers.reserve(m_workers.size());
+    for (auto& worker : m_workers)
+    {
+        const Stats& stats = worker->stats;
+        Metrics::WorkerMetrics item;
+        item.thread_id = worker->thread_id.load(std::memory_order_relaxed);
+        item.submitted = stats.submitted.load(std::memory_order_relaxed);
+        item.executed = stats.executed.load(std::memory_order_relaxed);
+        item.parks = stats.parks.load(std::memory_order_relaxed);
+        item.unparks = stats.unparks.load(std::memory_order_relaxed);
+        item.busy_ns = PeriodTotal(stats.busy_since, stats.busy_ns, now);
+        item.idle_ns = PeriodTotal(stats.idle_since, stats.idle_ns, now);
+        item.queue_depth = worker->deque.size() + worker->inbox.size();
+        stats.wait_ns.mergeInto(metrics.wait_ns);
+
+        metrics.submitted += item.submitted;
+        metrics.executed += item.executed;
+        metrics.parks += item.parks;
+        metrics.unparks += item.unparks;
+        metrics.queue_depth += item.queue_depth;
+        metrics.threads += (item.thread_id != -1);
+        metrics.active_threads += stats.active.load(std::memory_order_relaxed);
+        metrics.workers.push_back(item);
+    }
+    return metrics;
+}
+
+void Scheduler::submit(Task* task, bool instant)
+{
+    if (task->fiber && task->fiber->m_shared_stack)
+    {
+        // 共享栈协程首次运行后绑定到所在线程的共享栈，不能被其他线程执行或者窃取
+        const long bound = task->fiber->sharedStackThread();
+        if (bound != -1 && task->thread_id != -1 && task->thread_id != bound)
+        {
+            Task::Destroy(task);
+            throw Exception("共享栈协程只能在首次运行的线程上调度");
+        }
+        if (bound != -1)
+        {
+            task->thread_id = bound;
+        }
+    }
+    const long thread_id = task->thread_id;
+    if (thread_id != -1)
+    {
+        // 绑定线程的任务直接交给目标线程
+        Worker* target = findWorker(thread_id);
+        if (target)
+        {
+            scheduleInbox(target, task);
+            return;
+        }
+    }
+    else if (m_work_stealing)
+    {
+        // 工作线程上产生的任务加入本线程的队列，不需要加锁
+        Worker* worker = localWorker();
+        if (worker)
+        {
+            scheduleLocal(worker, task);
+            return;
+        }
+    }
+    if (!task->fiber && !task->callback)
+    {
+        Task::Destroy(task);
+        return;
+    }
+    onEnqueue(task);
+    {
+        ScopedLock lock(&m_mutex);
+        pushGlobalTask(task, instant);
+    }
+    // 该工作了：绑定线程的任务唤醒指定线程，否则唤醒一个休眠的工作线程
+    if (thread_id == -1)
+    {
+        tickle();
+    }
+    else
+    {
+        unpark(thread_id, false);
+    }
+}
+
+void Scheduler::runInline(Task* task)
+{
+    // 任务结束或者抛出异常时归还节点
+    std::unique_ptr<Task, void (*)(Task*)> guard(task, &Task::Destroy);
+    try
+    {
+        task->callback();
+    }
+    catch (std::exception& e)
+    {
+        ERROR("Scheduler inline task exception: %s", e.what());
+    }
+    catch (...)
+    {
+        ERROR("Scheduler inline task exception");
+    }
+    // 任务写入的协程局部存储落在调度协程上，不能留给之后的任务
+    GetMainFiber()->clearLocals();
+}
+
+void Scheduler::scheduleLocal(Worker* worker, Task* task)
+{
+    if (!task->fiber && !task->callback)
+    {
+        Task::Destroy(task);
+        return;
+    }
+    onEnqueue(task);
+    worker->deque.push(task);
+    tickle();
+}
+
+Scheduler::Worker* Scheduler::findWorker(long thread_id)
+{
+    for (auto& worker : m_workers)
+    {
+        if (worker->thread_id.load(std::memory_order_acquire) == thread_id)
+        {
+            return worker.get();
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::scheduleInbox(Worker* worker, Task* task)
+{
+    if (!task->fiber && !task->callback)
+    {
+        Task::Destroy(task);
+        return;
+    }
+    onEnqueue(task);
+    // 加入之后任务可能马上被执行并释放，先取出线程 id
+    const long thread_id = task->thread_id;
+    worker->inbox.push(task);
+    // 查找之后目标线程可能已经退出并取完了收件箱，与 releaseWorker 配对检查
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (worker->thread_id.load(std::memory_order_relaxed) != thread_id)
+    {
+        rescueInbox(worker);
+        return;
+    }
+    unpark(thread_id, false);
+}
+
+void Scheduler::rescueInbox(Worker* worker)
+{
+    size_t moved = 0;
+    {
+        ScopedLock lock(&m_mutex);
+        // 槽位已经被新的线程使用时由新线程取出
+        if (worker->thread_id.load(std::memory_order_relaxed) != -1)
+        {
+            return;
+        }
+        Task* task = nullptr;
+        while ((task = worker->inbox.pop()) != nullptr)
+        {
+            task->thread_id = -1;
+            pushGlobalTask(task, false);
+            ++moved;
+        }
+    }
+    while (moved-- > 0)
+    {
+        tickle();
+    }
+}
+
+Scheduler::Task* Scheduler::takeInboxTask(Worker* worker)
+{
+    Task* task = worker->inbox.pop();
+    if (task == nullptr)
+    {
+        return nullptr;
+    }
+    if (task->fiber && task->fiber->getState() == Fiber::EXEC)
+    {
+        // 协程被唤醒时还没有在其他线程上完成切换，交给全局队列稍后执行
+        ScopedLock lock(&m_mutex);
+        pushGlobalTask(task, false);
+        return nullptr;
+    }
+    worker->stats.active.store(1, std::memory_order_relaxed);
+    return task;
+}
+
+uint64_t Scheduler::DeadlineFromNow(uint64_t ms)
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec + ms * 1000000ull;
+}
+
+bool Scheduler::Runnable(const Task* task)
+{
+    assert(task->fiber || task->callback);
+    // 任务指定了其他线程执行，提交时已经唤醒了指定的线程
+    if (task->thread_id != -1 && task->thread_id != Log::GetThreadId())
+    {
+        return false;
+    }
+    // 协程正在其他线程上执行
+    return !(task->fiber && task->fiber->getState() == Fiber::EXEC);
+}
+
+void Scheduler::pushGlobalTask(Task* task, bool front)
+{
+    TaskQueue& queue = m_queues[task->priority];
+    task->next = nullptr;
+    if (task->deadline_ns != 0)
+    {
+        queue.deadlines.push_back(task);
+        std::push_heap(queue.deadlines.begin(), queue.deadlines.end(), LaterDeadline());
+    }
+    else if (queue.head == nullptr)
+    {
+        queue.head = queue.tail = task;
+    }
+    else if (front)
+    {
+        task->next = queue.head;
+        queue.head = task;
+    }
+    else
+    {
+        queue.tail->next = task;
+        queue.tail = task;
+    }
+    ++m_global_task_count;
+    if (task->priority == HIGH || task->deadline_ns != 0)
+    {
+        ++m_urgent_task_count;
+    }
+}
+
+Scheduler::Task* Scheduler::takeGlobalTask(size_t level)
+{
+    TaskQueue& queue = m_queues[level];
+    Task* task = nullptr;
+    // 截止时间最早的任务先执行
+    auto& heap = queue.deadlines;
+    if (!heap.empty() && Runnable(heap.front()))
+    {
+        std::pop_heap(heap.begin(), heap.end(), LaterDeadline());
+        task = heap.back();
+        heap.pop_back();
+    }
+    else if (!heap.empty())
+    {
+        // 堆顶的任务不能在当前线程执行，选择可以执行的截止时间最早的任务
+        auto best = heap.end();
+        for (auto it = heap.begin(); it != heap.end(); ++it)
+        {
+            if (Runnable(*it) && (best == heap.end() || (*it)->deadline_ns < (*best)->deadline_ns))
+            {
+                best = it;
+            }
+        }
+        if (best != heap.end())
+        {
+            task = *best;
+            *best = heap.back();
+            heap.pop_back();
+            std::make_heap(heap.begin(), heap.end(), LaterDeadline());
+        }
+    }
+    if (task == nullptr)
+    {
+        Task* prev = nullptr;
+        for (task = queue.head; task != nullptr; prev = task, task = task->next)
+        {
+            if (Runnable(task))
+            {
+                // 从队列中摘下节点
+                (prev ? prev->next : queue.head) = task->next;
+                if (queue.tail == task)
+                {
+                    queue.tail = prev;
+                }
+                task->next = nullptr;
+                break;
+            }
+        }
+    }
+    if (task)
+    {
+        --m_global_task_count;
+        if (task->priority == HIGH || task->deadline_ns != 0)
+        {
+            --m_urgent_task_count;
+        }
+    }
+    return task;
+}
+
+Scheduler::Task* Scheduler::takeGlobalTask(Worker* worker, bool& tickle_me)
+{
+    ScopedLock lock(&m_mutex);
+    if (m_global_task_count == 0)
+    {
+        return nullptr;
+    }
+    // 被连续跳过太多次的低优先级先执行一个，其余按优先级从高到低
+    const uint64_t limit = SchedulerInfo::g_starvation_limit->getValue();
+    size_t order[kPriorityCount];
+    size_t count = 0;
+    for (size_t level = kPriorityCount - 1; level > 0; --level)
+    {
+        if (m_queues[level].skipped >= limit && !m_queues[level].empty())
+        {
+            order[count++] = level;
+            break;
+        }
+    }
+    for (size_t level = 0; level < kPriorityCount; ++level)
+    {
+        if (count == 0 || order[0] != level)
+        {
+            order[count++] = level;
+        }
+    }
+    for (size_t i = 0; i < kPriorityCount; ++i)
+    {
+        const size_t level = order[i];
+        Task* task = takeGlobalTask(level);
+        if (task == nullptr)
+        {
+            continue;
+        }
+        m_queues[level].skipped = 0;
+        for (size_t lower = level + 1; lower < kPriorityCount; ++lower)
+        {
+            if (!m_queues[lower].empty())
+            {
+                ++m_queues[lower].skipped;
+            }
+        }
+        worker->stats.active.store(1, std::memory_order_relaxed);
+        tickle_me |= (m_global_task_count != 0);
+        return task;
+    }
+    return nullptr;
+}
+
+Scheduler::Task* Scheduler::takeLocalTask(Worker* worker, bool steal)
+{
+    Task* task = nullptr;
+    if (!steal && !worker->deque.pop(task))
+    {
+        return nullptr;
+    }
+    if (steal)
+    {
+        // 从随机的起点开始依次尝试窃取其他工作线程的任务
+        const size_t count = m_workers.size();
+        worker->random_state ^= worker->random_state << 13;
+        worker->random_state ^= worker->random_state >> 7;
+        worker->random_state ^= worker->random_state << 17;
+        const size_t start = worker->random_state % count;
+        bool stolen = false;
+        for (size_t i = 0; i < count && !stolen; ++i)
+        {
+            Worker* victim = m_workers[(start + i) % count].get();
+            stolen = (victim != worker && victim->deque.steal(task));
+        }
+        if (!stolen)
+        {
+            return nullptr;
+        }
+    }
+    if (task->fiber && task->fiber->getState() == Fiber::EXEC)
+    {
+        // 协程被唤醒时还没有在原线程上完成切换，交给全局队列稍后执行
+        ScopedLock lock(&m_mutex);
+        pushGlobalTask(task, false);
+        return nullptr;
+    }
+    worker->stats.active.store(1, std::memory_order_relaxed);
+    return task;
+}
+
+void Scheduler::run()
+{
+    t_scheduler = this;
+    if (Log::GetThreadId() != m_root_thread_id)
+    {
+        // 新建的线程，调度协程就是线程的 master fiber
+        t_scheduler_fiber = Fiber::GetThis().get();
+    }
+    t_worker_index = static_cast<long>(claimWorker());
+    assert(static_cast<size_t>(t_worker_index) < m_workers.size());
+    Worker* worker = m_workers[t_worker_index].get();
+    worker->retiring = false;
+    worker->idle_streak_since = 0;
+    if (m_metrics)
+    {
+        worker->stats.busy_since.store(FiberAccounting::Now(), std::memory_order_relaxed);
+    }
+    // 没有任务时执行的协程
+    auto idle_fiber = std::make_shared<Fiber>(std::bind(&Scheduler::onIdle, this));
+    // 执行可调用对象任务的协程，从线程的协程池中获取
+    Fiber::ptr callback_fiber;
+    while (true)
+    {
+        Task* task = nullptr;
+        bool tickle_me = false;
+        // 优先执行收件箱和本地队列中的任务，并定期检查全局队列，全局队列中有高优先级或者设置了截止时间的任务时
+        // 先检查全局队列；本线程的队列为空时依次检查全局队列、窃取其他线程的任务
+        if (++worker->local_tick % kGlobalCheckInterval == 0 || m_urgent_task_count != 0)
+        {
+            task = takeGlobalTask(worker, tickle_me);
+        }
+        task = task ? task : takeInboxTask(worker);
+        if (m_work_stealing)
+        {
+            task = task ? task : takeLocalTask(worker, false);
+            task = task ? task : takeGlobalTask(worker, tickle_me);
+            task = task ? task : takeLocalTask(worker, true);
+        }
+        else
+        {
+            task = task ? task : takeGlobalTask(worker, tickle_me);
+        }
+        if (tickle_me)
+        {
+            tickle();
+        }
+        // 任务开始执行的时间，统计等待时间或者启动了 watchdog 时才读取时钟
+        uint64_t start_ns = 0;
+        if (task)
+        {
+            worker->idle_streak_since = 0;
+            IncrementOwned(worker->stats.executed);
+            if (task->enqueue_ns != 0 || m_watchdog_budget_ns != 0)
+            {
+                start_ns = FiberAccounting::Now();
+            }
+            if (task->enqueue_ns != 0)
+            {
+                const uint64_t wait_ns = start_ns - task->enqueue_ns;
+                worker->stats.wait_ns.add(wait_ns);
+#ifdef FIBER_ACCOUNTING
+                FiberAccounting::RecordWait(
+                    task->fiber ? *task->fiber->m_run_entry : task->callback.target_type(),
+                    wait_ns);
+#endif
+            }
+        }
+
+        if (task && task->run_inline)
+        {
+            // 不会让出执行权的可调用对象直接在调度协程上执行，不需要协程栈与上下文切换
+            beginRun(worker, start_ns, 0, task->callback.target_type());
+            runInline(task);
+            endRun(worker);
+            worker->stats.active.store(0, std::memory_order_relaxed);
+        }
+        else if (task && task->fiber && !task->fiber->finish())
+        {
+            Fiber::ptr fiber = std::move(task->fiber);
+            Task::Destroy(task);
+            beginRun(worker, start_ns, fiber->getID(), *fiber->m_run_entry);
+            fiber->swapIn();
+            endRun(worker);
+            worker->stats.active.store(0, std::memory_order_relaxed);
+            if (fiber->getState() == Fiber::READY)
+            {
+                schedule(std::move(fiber));
+            }
+            else if (!fiber->finish())
+            {
+                fiber->setState(Fiber::HOLD);
+            }
+            // 执行结束（TERM）或者抛出异常（EXCEPTION）的协程在这里释放
+        }
+        else if (task && task->callback)
+        {
+            // 可调用对象留在任务节点中由协程直接调用，协程的执行函数只捕获节点指针，
+            // 可以存放在 std::function 的内部缓冲区中，不需要分配内存；协程结束时归还节点
+            callback_fiber = Fiber::Acquire([task]() {
+                std::unique_ptr<Task, void (*)(Task*)> guard(task, &Task::Destroy);
+                task->callback();
+            });
+            callback_fiber->setEntryType(task->callback.target_type());
+            beginRun(worker, start_ns, callback_fiber->getID(), *callback_fiber->m_run_entry);
+            callback_fiber->swapIn();
+            endRun(worker);
+            worker->stats.active.store(0, std::memory_order_relaxed);
+            if (callback_fiber->getState() == Fiber::READY)
+            {
+                schedule(std::move(callback_fiber));
+            }
+            else if (callback_fiber->finish())
+            {
+                // 执行结束或者抛出异常的协程归还协程池，供下一个任务复用
+                Fiber::Recycle(std::move(callback_fiber));
+            }
+            else
+            {
+                callback_fiber->setState(Fiber::HOLD);
+            }
+            callback_fiber.reset();
+        }
+        else
+        {
+            if (task)
+            {
+                // 协程任务在加入队列后已经执行结束
+                Task::Destroy(task);
+                worker->stats.active.store(0, std::memory_order_relaxed);
+                continue;
+            }
+            if (idle_fiber->finish())
+            {
+                VERBOSE("Scheduler::run idle fiber terminated");
+                if (!worker->retiring)
+                {
+                    // 调度器已经停止，唤醒其他休眠的线程尽快退出
+                    unpark(-1, true);
+                }
+                if (m_metrics)
+                {
+                    EndPeriod(worker->stats.busy_since, worker->stats.busy_ns, FiberAccounting::Now());
+                }
+                releaseWorker(worker);
+                t_worker_index = -1;
+                break;
+            }
+            if (m_metrics)
+            {
+                const uint64_t now = FiberAccounting::Now();
+                EndPeriod(worker->stats.busy_since, worker->stats.busy_ns, now);
+                worker->stats.idle_since.store(now, std::memory_order_relaxed);
+                if (worker->idle_streak_since == 0)
+                {
+                    worker->idle_streak_since = now;
+                }
+            }
+            ++m_idle_thread_count;
+            idle_fiber->swapIn();
+            --m_idle_thread_count;
+            if (m_metrics)
+            {
+                const uint64_t now = FiberAccounting::Now();
+                EndPeriod(worker->stats.idle_since, worker->stats.idle_ns, now);
+                worker->stats.busy_since.store(now, std::memory_order_relaxed);
+            }
+            if (!idle_fiber->finish())
+            {
+                idle_fiber->setState(Fiber::HOLD);
+            }
+        }
+    }
+}
@@ -1,10 +1,269 @@
 #include "timer.h"
+#include "log.h"
+#include <algorithm>
 
-bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) {
+/**
+ * 分层时间轮
+ * 第 0 层 256 个槽位，每个槽位 1 毫秒；第 1~4 层各 64 个槽位，每个槽位覆盖下一层转一圈的时间，
+ * 总共覆盖 2^32 毫秒（约 49 天），更远的定时器先放在最高层，级联时重新放置。
+ * 游标每转到上层槽位的起点，就把该槽位的定时器整体下放到下层（级联）；第 0 层槽位里的定时器在游标
+ * 经过时成批到期。每层用位图记录非空槽位，推进游标时直接跳过空槽位。
+ * 不是线程安全的，由 TimerManager 的锁保护。
+*/
+struct TimerManager::TimingWheel
+{
+    static constexpr int kLevels = 5;
+    static constexpr uint32_t kRootBits = 8;
+    static constexpr uint32_t kLevelBits = 6;
+    static constexpr uint32_t kMaxSlots = 1u << kRootBits;
+    static constexpr uint64_t kSpan = 1ull << (kRootBits + kLevelBits * (kLevels - 1));
+
+    explicit TimingWheel(uint64_t now)
+        : current(now) {}
+
+    ~TimingWheel()
+    {
+        // 释放时间轮持有的引用，定时器可能因此析构，先取出下一个
+        for (int level = 0; level < kLevels; ++level)
+        {
+            for (uint32_t index = 0; index < Slots(level); ++index)
+            {
+                Timer* timer = slots[level][index];
+                while (timer)
+                {
+                    Timer* next = timer->m_wheel_next;
+                    timer->m_wheel_prev = timer->m_wheel_next = nullptr;
+                    timer->m_wheel_level = -1;
+                    timer->m_wheel_self.reset();
+                    timer = next;
+                }
+            }
+        }
+    }
+
+    // 第 level 层一个槽位的时间是 2^Shift(level) 毫秒
+    static uint32_t Shift(int level)
+    {
+        return level == 0 ? 0 : kRootBits + kLevelBits * (level - 1);
+    }
+
+    static uint32_t Slots(int level)
+    {
+        return level == 0 ? 1u << kRootBits : 1u << kLevelBits;
+    }
+
+    // 按到期时间与游标的距离选择层与槽位，已经到期的定时器放在游标所在的槽位
+    void link(Timer* timer)
+    {
+        uint64_t expires = std::max(timer->m_next, current);
+        uint64_t delta = expires - current;
+        if (delta >= kSpan)
+        {
+            delta = kSpan - 1;
+            expires = current + delta;
+        }
+        int level = 0;
+        while (level + 1 < kLevels && delta >= (1ull << Shift(level + 1)))
+        {
+            ++level;
+        }
+        const uint32_t index = (expires >> Shift(level)) & (Slots(level) - 1);
+        Timer*& head = slots[level][index];
+        timer->m_wheel_prev = nullptr;
+        timer->m_wheel_next = head;
+        if (head)
+        {
+            head->m_wheel_prev = timer;
+        }
+        head = timer;
+        bitmap[level][index / 64] |= 1ull << (index % 64);
+        timer->m_wheel_level = level;
+        timer->m_wheel_index = index;
+        ++count;
+    }
+
+    void unlink(Timer* timer)
+    {
+        Timer*& head = slots[timer->m_wheel_level][timer->m_wheel_index];
+        if (timer->m_wheel_prev)
+        {
+            timer->m_wheel_prev->m_wheel_next = timer->m_wheel_next;
+        }
+        else
+        {
+            head = timer->m_wheel_next;
+        }
+        if (timer->m_wheel_next)
+        {
+            timer->m_wheel_next->m_wheel_prev = timer->m_wheel_prev;
+        }
+        if (!head)
+        {
+            const uint32_t index = timer->m_wheel_index;
+            bitmap[timer->m_wheel_level][index / 64] &= ~(1ull << (index % 64));
+        }
+        timer->m_wheel_prev = timer->m_wheel_next = nullptr;
+        timer->m_wheel_level = -1;
+        --count;
+    }
+
+    // 取出整个槽位的链表，调用者负责逐个处理链表中的定时器与 count
+    Timer* take(int level, uint32_t index)
+    {
+        Timer* head = slots[level][index];
+        slots[level][index] = nullptr;
+        bitmap[level][index / 64] &= ~(1ull << (index % 64));
+        return head;
+    }
+
+    // 从 from 开始循环查找第 level 层第一个非空的槽位，返回与 from 的距离，没有时返回 -1
+    int findNext(int level, uint32_t from) const
+    {
+        const uint32_t size = Slots(level);
+        const uint32_t words = (size + 63) / 64;
+        const uint32_t offset = from % 64;
+        for (uint32_t i = 0; i <= words; ++i)
+        {
+            const uint32_t word = (from / 64 + i) % words;
+            uint64_t bits = bitmap[level][word];
+            if (i == 0)
+            {
+                bits &= ~0ull << offset;
+            }
+            else if (i == words)
+            {
+                // 回到起始的字，只剩 from 之前的位
+                bits &= offset ? (1ull << offset) - 1 : 0;
+            }
+            if (bits)
+            {
+                const uint32_t index = word * 64 + __builtin_ctzll(bits);
+                return static_cast<int>((index + size - from) % size);
+            }
+        }
+        return -1;
+    }
+
+    // 游标到达上层槽位的起点时，把槽位里的定时器下放到下层；本层转完一圈时继续级联更上一层
+    void cascade()
+    {
+        for (int level = 1; level < kLevels; ++level)
+        {
+            const uint32_t index = (current >> Shift(level)) & (Slots(level) - 1);
+            Timer* timer = take(level, index);
+            while (timer)
+            {
+                Timer* next = timer->m_wheel_next;
+                --count;
+                link(timer);
+                timer = next;
+            }
+            if (index != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    // 推进游标到 now，取出到期的定时器（连同时间轮持有的引用）
+    void advance(uint64_t now, std::vector<Timer::ptr>& expired)
+    {
+        while (current <= now)
+        {
+            if (count == 0)
+            {
+                current = now + 1;
+                break;
+            }
+            const uint32_t index = current & (Slots(0) - 1);
+            if (index == 0)
+            {
+                cascade();
+            }
+            Timer* timer = take(0, index);
+            while (timer)
+            {
+                Timer* next = timer->m_wheel_next;
+                timer->m_wheel_prev = timer->m_wheel_next = nullptr;
+                timer->m_wheel_level = -1;
+                --count;
+                expired.push_back(std::move(timer->m_wheel_self));
+                timer = next;
+            }
+            // 跳到本圈下一个非空的槽位，没有时跳到下一圈的起点（需要级联）
+            uint64_t step = Slots(0) - index;
+            if (index + 1 < Slots(0))
+            {
+                const int distance = findNext(0, index + 1);
+                if (distance >= 0 && index + 1 + distance < Slots(0))
+                {
+                    step = 1 + distance;
+                }
+            }
+            current = std::min(current + step, now + 1);
+        }
+    }
+
+    // 取出所有定时器
+    void drain(std::vector<Timer::ptr>& expired)
+    {
+        for (int level = 0; level < kLevels; ++level)
+        {
+            for (uint32_t index = 0; index < Slots(level); ++index)
+            {
+                Timer* timer = take(level, index);
+                while (timer)
+                {
+                    Timer* next = timer->m_wheel_next;
+                    timer->m_wheel_prev = timer->m_wheel_next = nullptr;
+                    timer->m_wheel_level = -1;
+                    expired.push_back(std::move(timer->m_wheel_self));
+                    timer = next;
+                }
+            }
+        }
+        count = 0;
+    }
+
+    // 下一次需要处理的时间：第 0 层是准确的到期时间，上层是槽位开始级联的时间（不晚于其中的定时器到期）
+    uint64_t nextExpire() const
+    {
+        if (count == 0)
+        {
+            return ~0ull;
+        }
+        uint64_t next = ~0ull;
+        const int distance = findNext(0, current & (Slots(0) - 1));
+        if (distance >= 0)
+        {
+            next = current + distance;
+        }
+        for (int level = 1; level < kLevels; ++level)
+        {
+            const uint32_t shift = Shift(level);
+            // 游标之后（含）第一个本层槽位的起点
+            const uint64_t boundary = (current + (1ull << shift) - 1) >> shift;
+            const int slot = findNext(level, boundary & (Slots(level) - 1));
+            if (slot >= 0)
+            {
+                next = std::min(next, (boundary + slot) << shift);
+            }
+        }
+        return next;
+    }
+
+    Timer* slots[kLevels][kMaxSlots] = {};
+    uint64_t bitmap[kLevels][kMaxSlots / 64] = {};
+    // 下一个要处理的毫秒
+    uint64_t current;
+    size_t count = 0;
+};
+
+bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const {
     // 判断指针的有效性
     if (!lhs && !rhs)
         return false;
-    if (!lhs) 
+    if (!lhs)
         return true;
     if (!rhs)
         return false;
@@ -23,12 +282,12 @@ bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs)
 
 Timer::Timer(
     uint64_t ms, std::function<void()> fn, bool cyclic, TimerManager* manager)
-    : m_cyclic(cyclic), 
-      m_ms(ms), 
-      m_fn(fn),
+    : m_cyclic(cyclic),
+      m_ms(ms),
+      m_fn(std::move(fn)),
       m_manager(manager)
 {
-    m_next = GetCurrentMS() + m_ms;
+    m_next = Log::GetCurrentMS() + m_ms;
 }
 
 Timer::Timer(uint64_t next) : m_next(next)
@@ -36,12 +295,13 @@ Timer::Timer(uint64_t next) : m_next(next)
 
 bool Timer::cancel()
 {
+    // 时间轮持有的引用可能是最后一个引用，保证返回之前自身有效
+    Timer::ptr self = shared_from_this();
     WriteScopedLock lock(&m_manager->m_lock);
     if (m_fn)
     {
         m_fn = nullptr;
-        auto it = m_manager->m_timers.find(shared_from_this());
-        m_manager->m_timers.erase(it);
+        m_manager->removeTimer(this, true);
         return true;
     }
     return false;
@@ -53,65 +313,63 @@ bool Timer::reset(uint64_t ms, bool from_now)
     {
         return true;
     }
-    if (!m_fn)
-    {
-        return false;
-    }
     WriteScopedLock lock(&m_manager->m_lock);
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if (it == m_manager->m_timers.end())
+    if (!m_fn || !m_manager->removeTimer(this, false))
     {
         return false;
     }
-    m_manager->m_timers.erase(it);
     uint64_t start = 0;
     // 重新计时
     if (from_now)
     {
-        start = GetCurrentMS();
+        start = Log::GetCurrentMS();
     }
-    else 
+    else
     {
         start = m_next - m_ms;
     }
     m_ms = ms;
     m_next = start + m_ms;
-    // it = m_manager->m_timers.insert(shared_from_this()).first;
-    m_manager->addTimer(shared_from_this(), lock);
+    bool at_front = m_manager->insertTimer(this);
+    lock.unlock();
+    if (at_front)
+    {
+        m_manager->onTimerInsertedAtFirst();
+    }
     return true;
 }
- 
+
 bool Timer::refresh()
 {
+    const uint64_t now_ms = Log::GetCurrentMS();
     WriteScopedLock lock(&m_manager->m_lock);
-    if (!m_fn)
+    if (!m_fn || !m_manager->removeTimer(this, false))
     {
         return false;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if (it == m_manager->m_timers.end())
-    {
-        return false;
-    }
-    m_manager->m_timers.erase(it);
-    m_next = GetCurrentMS() + m_ms;
-    m_manager->m_timers.insert(shared_from_this());
+    // 到期时间只会推后，不需要通知等待的线程
+    m_next = now_ms + m_ms;
+    m_manager->insertTimer(this);
     return true;
 }
 
 TimerManager::TimerManager()
 {
-    m_previous_time = GetCurrentMS();
+    m_previous_time = Log::GetCurrentMS();
+    if (TimerInfo::g_use_wheel->getValue())
+    {
+        m_wheel.reset(new TimingWheel(m_previous_time));
+    }
 }
 
 TimerManager::~TimerManager()
-{ 
+{
 }
 
 Timer::ptr TimerManager::addTimer(
     uint64_t ms, std::function<void()> fn, bool cyclic)
 {
-    Timer::ptr timer(new Timer(ms, fn, cyclic, this)); 
+    Timer::ptr timer(new Timer(ms, std::move(fn), cyclic, this));
     WriteScopedLock lock(&m_lock);
     addTimer(timer, lock);
     return timer;
@@ -119,8 +377,7 @@ Timer::ptr TimerManager::addTimer(
 
 void TimerManager::addTimer(Timer::ptr timer, WriteScopedLock& lock)
 {
-    auto it = m_timers.insert(timer).first;
-    bool at_front = (it == m_timers.begin());
+    bool at_front = insertTimer(timer.get());
     lock.unlock();
     if (at_front)
     {
@@ -128,6 +385,57 @@ void TimerManager::addTimer(Timer::ptr timer, WriteScopedLock& lock)
     }
 }
 
+bool TimerManager::insertTimer(Timer* timer)
+{
+    if (m_wheel)
+    {
+        if (m_wheel->count == 0)
+        {
+            // 空的时间轮没有推进游标，从当前时间开始放置，避免多余的级联
+            m_wheel->current = Log::GetCurrentMS();
+        }
+        if (!timer->m_wheel_self)
+        {
+            timer->m_wheel_self = timer->shared_from_this();
+        }
+        m_wheel->link(timer);
+    }
+    else
+    {
+        m_timers.insert(timer->shared_from_this());
+    }
+    if (timer->m_next < m_notify_before.load(std::memory_order_relaxed))
+    {
+        m_notify_before.store(timer->m_next, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool TimerManager::removeTimer(Timer* timer, bool release)
+{
+    if (m_wheel)
+    {
+        if (timer->m_wheel_level < 0)
+        {
+            return false;
+        }
+        m_wheel->unlink(timer);
+        if (release)
+        {
+            timer->m_wheel_self.reset();
+        }
+        return true;
+    }
+    auto it = m_timers.find(timer->shared_from_this());
+    if (it == m_timers.end())
+    {
+        return false;
+    }
+    m_timers.erase(it);
+    return true;
+}
+
 static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> fn)
 {
     auto tmp = weak_cond.lock();
@@ -138,7 +446,7 @@ static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> fn)
 }
 
 Timer::ptr TimerManager::addConditionTimer(
-    uint64_t ms, std::function<void()> fn, 
+    uint64_t ms, std::function<void()> fn,
     std::weak_ptr<void> weak_cond, bool cyclic)
 {
     return addTimer(ms, std::bind(&OnTimer, weak_cond, fn), cyclic);
@@ -147,32 +455,41 @@ Timer::ptr TimerManager::addConditionTimer(
 uint64_t TimerManager::getNextTimer()
 {
     ReadScopedLock lock(&m_lock);
-    if (m_timers.empty())
+    uint64_t next = ~0ull;
+    if (m_wheel)
+    {
+        next = m_wheel->nextExpire();
+    }
+    else if (!m_timers.empty())
+    {
+        next = (*m_timers.begin())->m_next;
+    }
+    m_notify_before.store(next, std::memory_order_relaxed);
+    if (next == ~0ull)
     {
         // 没有定时器
         return ~0ull;
     }
-    const Timer::ptr& next = *m_timers.begin();
-    uint64_t now_ms = GetCurrentMS();
-    if (now_ms >= next->m_next)
+    uint64_t now_ms = Log::GetCurrentMS();
+    if (now_ms >= next)
     {
         // 等待超时
         return 0;
     }
-    else 
+    else
     {
         // 返回剩余的等待时间
-        return next->m_next - now_ms;
+        return next - now_ms;
     }
 }
 
 void TimerManager::listExpiredCallback(std::vector<std::function<void()>>& fns)
 {
-    uint64_t now_ms = GetCurrentMS();
+    uint64_t now_ms = Log::GetCurrentMS();
     std::vector<Timer::ptr> expired;
     {
         ReadScopedLock lock(&m_lock);
-        if (m_timers.empty())
+        if (m_wheel ? m_wheel->count == 0 : m_timers.empty())
         {
             return;
         }
@@ -180,56 +497,75 @@ void TimerManager::listExpiredCallback(std::vector<std::function<void()>>& fns)
     WriteScopedLock lock(&m_lock);
     // 检查系统时间是否被修改
     bool rollover = detectClockRollover(now_ms);
-    // 系统时间未被回拨，并且无定时器等待超时
-    if (!rollover && (*m_timers.begin())->m_next > now_ms)
+    if (m_wheel)
     {
-        return;
+        // ** 如果系统时间被修改过，直接认定所有定时器均超时 **
+        if (rollover)
+        {
+            m_wheel->drain(expired);
+            m_wheel->current = now_ms;
+        }
+        else
+        {
+            m_wheel->advance(now_ms, expired);
+        }
     }
-    Timer::ptr now_timer(new Timer(now_ms));
-    // 获取第一个 m_next 大于或等于 now_timer->m_next 的定时器的迭代器
-    // 就是已经等待到达或超时的定时器。
-    // ** 如果系统时间被修改过，直接认定所有定时器均超时 **
-    auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
-    // 包括上到达指定时间的定时器
-    while (it != m_timers.end() && (*it)->m_next == now_timer->m_next)
+    // 系统时间被回拨，或者有定时器等待超时
+    else if (!m_timers.empty() && (rollover || (*m_timers.begin())->m_next <= now_ms))
     {
-        ++it;
+        Timer::ptr now_timer(new Timer(now_ms));
+        // 获取第一个 m_next 大于或等于 now_timer->m_next 的定时器的迭代器
+        // 就是已经等待到达或超时的定时器。
+        // ** 如果系统时间被修改过，直接认定所有定时器均超时 **
+        auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
+        // 包括上到达指定时间的定时器
+        while (it != m_timers.end() && (*it)->m_next == now_timer->m_next)
+        {
+            ++it;
+        }
+        // 取出超时的定时器
+        expired.insert(expired.begin(), m_timers.begin(), it);
+        m_timers.erase(m_timers.begin(), it);
     }
-    // 取出超时的定时器
-    expired.insert(expired.begin(), m_timers.begin(), it);
-    m_timers.erase(m_timers.begin(), it);
-    fns.reserve(expired.size());
+    fns.reserve(fns.size() + expired.size());
     for (auto& timer : expired)
     {
-        fns.push_back(timer->m_fn);
         // 处理周期定时器
         if (timer->m_cyclic)
         {
+            fns.push_back(timer->m_fn);
             timer->m_next = now_ms + timer->m_ms;
-            m_timers.insert(timer);
+            insertTimer(timer.get());
         }
         else
         {
+            fns.push_back(std::move(timer->m_fn));
             timer->m_fn = nullptr;
         }
-    }    
+    }
+}
+
+bool TimerManager::hasTimer()
+{
+    ReadScopedLock lock(&m_lock);
+    return m_wheel ? m_wheel->count != 0 : !m_timers.empty();
 }
 
-bool TimerManager::hasTimer() 
+size_t TimerManager::timerCount()
 {
     ReadScopedLock lock(&m_lock);
-    return !m_timers.empty();
+    return m_wheel ? m_wheel->count : m_timers.size();
 }
 
 bool TimerManager::detectClockRollover(uint64_t now_ms)
 {
     bool rollover = false;
     // 系统时间被回拨超过一个小时
-    if (now_ms < m_previous_time && 
+    if (now_ms < m_previous_time &&
         now_ms < (m_previous_time - 60 * 60 * 1000))
     {
         rollover = true;
     }
     m_previous_time = now_ms;
     return rollover;
-}
\ No newline at end of file
+}
@@ -0,0 +1,22 @@
+#ifndef __TEST_H__
+#define __TEST_H__
+
+/**
+ * 测试程序共用的检查宏，与 assert 不同，定义 NDEBUG 时同样生效
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+// 条件不成立时输出位置与条件并终止进程，ctest 据此判定测试失败
+#define CHECK(cond)                                                                   \
+    do                                                                                \
+    {                                                                                 \
+        if (!(cond))                                                                  \
+        {                                                                             \
+            ::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ::abort();                                                                \
+        }                                                                             \
+    } while (0)
+
+#endif // __TEST_H__
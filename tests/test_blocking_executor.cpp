@@ -0,0 +1,87 @@
+/**
+ * BlockingExecutor 测试：协程中的阻塞操作交给线程池执行，协程之外的调用者直接在当前线程执行
+*/
+#include "blocking_executor.h"
+#include "log.h"
+#include "scheduler.h"
+#include "test.h"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+// 没有默认构造函数、只能移动的返回值
+struct Handle
+{
+    explicit Handle(int value) : value(value) {}
+    Handle(Handle&&) = default;
+    Handle(const Handle&) = delete;
+
+    int value;
+};
+
+// 构造调度器的线程不在调度器的协程中，操作在当前线程上执行
+static void TestRunFromCaller(BlockingExecutor& executor)
+{
+    const long caller = Log::GetThreadId();
+    CHECK(executor.run([]() { return Log::GetThreadId(); }) == caller);
+    CHECK(BlockingCall([]() { return 7; }) == 7);
+    CHECK(executor.run([]() { return Handle(3); }).value == 3);
+}
+
+// 协程中的操作在线程池中执行，等待期间工作线程继续执行其他协程
+static void TestRunFromFiber(Scheduler& scheduler, BlockingExecutor& executor)
+{
+    static constexpr int kFibers = 4;
+    std::atomic<int> done{0};
+    std::atomic<int> offloaded{0};
+    std::atomic<int> caught{0};
+    auto begin = Clock::now();
+    for (int i = 0; i < kFibers; ++i)
+    {
+        scheduler.schedule([&executor, &done, &offloaded, &caught, i]() {
+            const long worker = Log::GetThreadId();
+            const long runner = executor.run([]() {
+                usleep(100000);
+                return Log::GetThreadId();
+            });
+            offloaded += (runner != worker);
+            CHECK(executor.run([i]() { return Handle(i); }).value == i);
+            executor.run([]() { usleep(1000); });
+            try
+            {
+                executor.run([]() -> int { throw std::runtime_error("blocking"); });
+            }
+            catch (std::runtime_error&)
+            {
+                ++caught;
+            }
+            ++done;
+        });
+    }
+    // 等待中的协程不计入调度器的任务，停止调度器之前等待操作完成
+    while (done.load() < kFibers)
+    {
+        usleep(1000);
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begin);
+    CHECK(offloaded.load() == kFibers);
+    CHECK(caught.load() == kFibers);
+    // 只有一个工作线程，4 个 100 毫秒的操作并发执行
+    CHECK(elapsed.count() < 4 * 100);
+}
+
+int main()
+{
+    Log::set_log_level(LERROR);
+    BlockingExecutor executor(8, 1000, "test_blocking");
+    Scheduler scheduler(2);
+    scheduler.start();
+    TestRunFromCaller(executor);
+    TestRunFromFiber(scheduler, executor);
+    scheduler.stop();
+    ::printf("test_blocking_executor passed\n");
+    return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * 无栈协程 Task<T> 测试，需要以 C++20 编译（ENABLE_CXX20）
+ * 任务在工作线程的调度协程上恢复，不占用 Fiber；Fiber 中通过 FiberAwait 等待任务的结果
+*/
+#include "coroutine.h"
+#include "log.h"
+#include "scheduler.h"
+#include "test.h"
+#include "timer.h"
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// 在恢复点检查任务没有运行在有独立栈的 Fiber 上
+static std::atomic<int> s_fiber_resumes{0};
+
+static void CheckStackless()
+{
+    if (Fiber::InSchedulerFiber())
+    {
+        ++s_fiber_resumes;
+    }
+}
+
+static Task<int> Square(Scheduler* scheduler, int value)
+{
+    co_await ScheduleOn(scheduler);
+    CheckStackless();
+    co_return value * value;
+}
+
+static Task<int> SumOfSquares(Scheduler* scheduler, int count)
+{
+    int sum = 0;
+    for (int i = 1; i <= count; ++i)
+    {
+        sum += co_await Square(scheduler, i);
+    }
+    co_return sum;
+}
+
+static Task<void> Fail(Scheduler* scheduler)
+{
+    co_await ScheduleOn(scheduler);
+    throw std::runtime_error("task");
+}
+
+static Task<void> Sleep(TimerManager* manager, uint64_t ms, std::atomic<int>* done)
+{
+    co_await SleepFor(manager, ms);
+    CheckStackless();
+    ++*done;
+}
+
+static Task<void> Report(Task<int> task, std::atomic<int>* result)
+{
+    *result = co_await task;
+}
+
+// 构造调度器的线程不在调度器的协程中，通过 Spawn 分离执行并轮询结果
+static void TestSpawnFromCaller(Scheduler& scheduler)
+{
+    std::atomic<int> result{0};
+    Spawn(&scheduler, Report(SumOfSquares(&scheduler, 10), &result));
+    while (result.load() == 0)
+    {
+        usleep(1000);
+    }
+    CHECK(result.load() == 385);
+}
+
+// Fiber 中等待任务的结果，异常在等待的 Fiber 中重新抛出
+static void TestFiberAwait(Scheduler& scheduler)
+{
+    std::atomic<bool> done{false};
+    scheduler.schedule([&scheduler, &done]() {
+        CHECK(FiberAwait(SumOfSquares(&scheduler, 3)) == 14);
+        bool caught = false;
+        try
+        {
+            FiberAwait(Fail(&scheduler));
+        }
+        catch (std::runtime_error&)
+        {
+            caught = true;
+        }
+        CHECK(caught);
+        done = true;
+    });
+    while (!done.load())
+    {
+        usleep(1000);
+    }
+}
+
+// 定时器到期后任务在挂起时所在的调度器上恢复
+static void TestSleepFor(Scheduler& scheduler)
+{
+    TimerManager manager;
+    std::atomic<bool> stopping{false};
+    std::thread timer_thread([&manager, &stopping]() {
+        std::vector<std::function<void()>> fns;
+        while (!stopping.load())
+        {
+            fns.clear();
+            manager.listExpiredCallback(fns);
+            for (auto& fn : fns)
+            {
+                fn();
+            }
+            usleep(1000);
+        }
+    });
+    static constexpr int kTasks = 16;
+    std::atomic<int> done{0};
+    for (int i = 0; i < kTasks; ++i)
+    {
+        scheduler.scheduleInline([&manager, &done, i]() {
+            Spawn(Scheduler::GetThis(), Sleep(&manager, i % 4 * 5, &done));
+        });
+    }
+    while (done.load() < kTasks)
+    {
+        usleep(1000);
+    }
+    stopping = true;
+    timer_thread.join();
+}
+
+int main()
+{
+    Log::set_log_level(LERROR);
+    Scheduler scheduler(2);
+    scheduler.start();
+    TestSpawnFromCaller(scheduler);
+    TestFiberAwait(scheduler);
+    TestSleepFor(scheduler);
+    scheduler.stop();
+    // 所有恢复都发生在调度协程上，没有占用 Fiber
+    CHECK(s_fiber_resumes.load() == 0);
+    ::printf("test_coroutine passed\n");
+    return 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * 协程同步原语测试：在工作线程的协程中挂起等待，在构造调度器的线程（use_caller）与
+ * Scheduler::scheduleInline 提交的任务中需要挂起时抛出 Exception，不挂起的方法正常工作
+*/
+#include "exception.h"
+#include "fiber_sync.h"
+#include "log.h"
+#include "scheduler.h"
+#include "test.h"
+#include <atomic>
+#include <unistd.h>
+
+// 等待计数达到 expect，等待中的协程不计入调度器的任务，停止调度器之前需要全部结束
+static void WaitFor(const std::atomic<int>& counter, int expect)
+{
+    while (counter.load() < expect)
+    {
+        usleep(1000);
+    }
+}
+
+// 多个协程在临界区内让出执行权，互斥锁保证计数不丢失
+static void TestMutex(Scheduler& scheduler)
+{
+    static constexpr int kFibers = 32;
+    static constexpr int kRounds = 200;
+    FiberMutex mutex;
+    int counter = 0;
+    std::atomic<int> done{0};
+    for (int i = 0; i < kFibers; ++i)
+    {
+        scheduler.schedule([&scheduler, &mutex, &counter, &done]() {
+            for (int j = 0; j < kRounds; ++j)
+            {
+                mutex.lock();
+                const int value = counter;
+                if (j % 16 == 0)
+                {
+                    scheduler.schedule(Fiber::GetThis());
+                    Fiber::YieldToHold();
+                }
+                counter = value + 1;
+                mutex.unlock();
+            }
+            ++done;
+        });
+    }
+    WaitFor(done, kFibers);
+    CHECK(counter == kFibers * kRounds);
+}
+
+// 条件变量与信号量：等待者在通知之前挂起，通知之后全部被唤醒
+static void TestConditionSemaphore(Scheduler& scheduler)
+{
+    static constexpr int kWaiters = 8;
+    FiberMutex mutex;
+    FiberCondition cond;
+    FiberSemaphore sem(0);
+    bool ready = false;
+    std::atomic<int> woken{0};
+    for (int i = 0; i < kWaiters; ++i)
+    {
+        scheduler.schedule([&mutex, &cond, &sem, &ready, &woken]() {
+            mutex.lock();
+            cond.wait(mutex, [&ready]() { return ready; });
+            mutex.unlock();
+            sem.wait();
+            ++woken;
+        });
+    }
+    usleep(10000);
+    CHECK(woken.load() == 0);
+    // 构造调度器的线程可以调用不挂起的方法
+    CHECK(mutex.tryLock());
+    ready = true;
+    mutex.unlock();
+    cond.notifyAll();
+    for (int i = 0; i < kWaiters; ++i)
+    {
+        sem.notify();
+    }
+    WaitFor(woken, kWaiters);
+}
+
+// 有界通道：多个生产者与消费者，关闭后消费者取完剩余数据后返回 false
+static void TestChannel(Scheduler& scheduler)
+{
+    static constexpr int kProducers = 4;
+    static constexpr int kConsumers = 4;
+    static constexpr int kItems = 1000;
+    Channel<int> channel(8);
+    std::atomic<long> sum{0};
+    std::atomic<int> producers{0};
+    std::atomic<int> consumers{0};
+    for (int i = 0; i < kConsumers; ++i)
+    {
+        scheduler.schedule([&channel, &sum, &consumers]() {
+            int value = 0;
+            while (channel.recv(value))
+            {
+                sum += value;
+            }
+            ++consumers;
+        });
+    }
+    for (int i = 0; i < kProducers; ++i)
+    {
+        scheduler.schedule([&channel, &producers]() {
+            for (int j = 1; j <= kItems; ++j)
+            {
+                CHECK(channel.send(j));
+            }
+            ++producers;
+        });
+    }
+    WaitFor(producers, kProducers);
+    channel.close();
+    WaitFor(consumers, kConsumers);
+    CHECK(sum.load() == static_cast<long>(kProducers) * kItems * (kItems + 1) / 2);
+    int value = 0;
+    CHECK(channel.trySend(value) == Channel<int>::CLOSED);
+    CHECK(!channel.send(1));
+}
+
+// 不能挂起的调用者：需要等待时抛出 Exception，原语的状态不受影响
+static void TestNotYieldable(Scheduler& scheduler)
+{
+    FiberMutex mutex;
+    FiberSemaphore sem(0);
+    Channel<int> channel(1);
+    CHECK(!Fiber::InSchedulerFiber());
+    mutex.lock();
+    bool threw = false;
+    try
+    {
+        mutex.lock();
+    }
+    catch (Exception&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    mutex.unlock();
+    CHECK(mutex.tryLock());
+    mutex.unlock();
+
+    threw = false;
+    try
+    {
+        sem.wait();
+    }
+    catch (Exception&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    sem.notify();
+    CHECK(sem.tryWait());
+
+    int value = 1;
+    CHECK(channel.trySend(value) == Channel<int>::OK);
+    threw = false;
+    try
+    {
+        channel.send(2);
+    }
+    catch (Exception&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(channel.tryRecv(value) == Channel<int>::OK && value == 1);
+    CHECK(channel.tryRecv(value) == Channel<int>::EMPTY);
+
+    // scheduleInline 提交的任务运行在调度协程上，同样不能挂起
+    std::atomic<int> inline_threw{0};
+    std::atomic<int> inline_done{0};
+    mutex.lock();
+    scheduler.scheduleInline([&mutex, &inline_threw, &inline_done]() {
+        try
+        {
+            mutex.lock();
+        }
+        catch (Exception&)
+        {
+            ++inline_threw;
+        }
+        ++inline_done;
+    });
+    WaitFor(inline_done, 1);
+    mutex.unlock();
+    CHECK(inline_threw.load() == 1);
+    CHECK(mutex.tryLock());
+    mutex.unlock();
+}
+
+int main()
+{
+    Log::set_log_level(LERROR);
+    Scheduler scheduler(3);
+    scheduler.start();
+    TestMutex(scheduler);
+    TestConditionSemaphore(scheduler);
+    TestChannel(scheduler);
+    TestNotYieldable(scheduler);
+    scheduler.stop();
+    ::printf("test_fiber_sync passed\n");
+    return 0;
+}
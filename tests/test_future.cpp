@@ -0,0 +1,96 @@
+/**
+ * Future/Promise 测试：分别在构造调度器的线程（use_caller）与工作线程的协程中等待结果
+*/
+#include "future.h"
+#include "log.h"
+#include "scheduler.h"
+#include "test.h"
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+
+// 构造调度器的线程在 stop() 之前运行在没有协程栈的 master fiber 上，只能阻塞线程等待
+static void TestWaitFromCaller(Scheduler& scheduler)
+{
+    CHECK(!Fiber::InSchedulerFiber());
+    Future<int> future = Async(&scheduler, []() {
+        usleep(100000);
+        return 1;
+    });
+    CHECK(future.get() == 1);
+
+    Future<void> done = Async(&scheduler, []() { usleep(10000); });
+    done.wait();
+    CHECK(done.isReady());
+    done.get();
+
+    std::vector<Future<int>> futures;
+    for (int i = 0; i < 8; ++i)
+    {
+        futures.push_back(Async(&scheduler, [i]() { return i * i; }));
+    }
+    std::vector<int> squares = WhenAll(futures).get();
+    CHECK(squares.size() == 8);
+    for (int i = 0; i < 8; ++i)
+    {
+        CHECK(squares[i] == i * i);
+    }
+}
+
+// 工作线程的协程中等待时挂起协程，then 的后续操作提交给当前调度器
+static void TestWaitFromFiber(Scheduler& scheduler)
+{
+    Promise<int> promise;
+    Future<int> result = promise.getFuture();
+    scheduler.schedule([&scheduler, promise = std::move(promise)]() mutable {
+        CHECK(Fiber::InSchedulerFiber());
+        Future<int> inner = Async(&scheduler, []() {
+            usleep(10000);
+            return 20;
+        });
+        Future<int> chained = inner.then([](int value) { return value + 1; });
+        promise.setValue(chained.get() * 2);
+    });
+    CHECK(result.get() == 42);
+}
+
+// 任务抛出的异常在等待者中重新抛出，无论等待者是否在协程中
+static void TestException(Scheduler& scheduler)
+{
+    bool caught = false;
+    try
+    {
+        Async(&scheduler, []() -> int { throw std::runtime_error("caller"); }).get();
+    }
+    catch (std::runtime_error&)
+    {
+        caught = true;
+    }
+    CHECK(caught);
+
+    Future<bool> in_fiber = Async(&scheduler, [&scheduler]() {
+        try
+        {
+            Async(&scheduler, []() -> int { throw std::runtime_error("fiber"); }).get();
+        }
+        catch (std::runtime_error&)
+        {
+            return true;
+        }
+        return false;
+    });
+    CHECK(in_fiber.get());
+}
+
+int main()
+{
+    Log::set_log_level(LERROR);
+    Scheduler scheduler(2);
+    scheduler.start();
+    TestWaitFromCaller(scheduler);
+    TestWaitFromFiber(scheduler);
+    TestException(scheduler);
+    scheduler.stop();
+    ::printf("test_future passed\n");
+    return 0;
+}
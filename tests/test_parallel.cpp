@@ -0,0 +1,116 @@
+/**
+ * fork-join 并行算法测试：分别从构造调度器的线程（use_caller）与工作线程的协程中调用
+*/
+#include "log.h"
+#include "parallel.h"
+#include "scheduler.h"
+#include "test.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+
+// 每个元素恰好执行一次；负载不均衡，最后一块常常由工作线程完成，调用者需要等待
+static void TestFor(Scheduler& scheduler)
+{
+    static constexpr size_t kCount = 2000;
+    for (int round = 0; round < 5; ++round)
+    {
+        std::vector<std::atomic<int>> visits(kCount);
+        ParallelFor(&scheduler, size_t(0), kCount,
+                    [&visits](size_t i) {
+                        if (i % 97 == 0)
+                        {
+                            usleep(500);
+                        }
+                        ++visits[i];
+                    },
+                    1);
+        for (auto& visit : visits)
+        {
+            CHECK(visit.load() == 1);
+        }
+    }
+}
+
+static void TestReduceSortInvoke(Scheduler& scheduler)
+{
+    const uint64_t sum = ParallelReduce(&scheduler, uint64_t(1), uint64_t(100001), uint64_t(0),
+                                        [](uint64_t i) { return i; },
+                                        [](uint64_t lhs, uint64_t rhs) { return lhs + rhs; });
+    CHECK(sum == 100000ull * 100001ull / 2);
+
+    std::vector<int> values(50000);
+    std::mt19937 rng(42);
+    for (auto& value : values)
+    {
+        value = static_cast<int>(rng());
+    }
+    std::vector<int> expected(values);
+    std::sort(expected.begin(), expected.end());
+    ParallelSort(&scheduler, values.begin(), values.end(), std::less<int>(), 1024);
+    CHECK(values == expected);
+
+    std::atomic<int> calls{0};
+    auto slow = [&calls]() {
+        usleep(1000);
+        ++calls;
+    };
+    auto fast = [&calls]() { ++calls; };
+    ParallelInvoke(&scheduler, slow, fast, slow, fast);
+    CHECK(calls.load() == 4);
+}
+
+// body 抛出的异常在调用者中重新抛出
+static void TestException(Scheduler& scheduler)
+{
+    bool caught = false;
+    try
+    {
+        ParallelFor(&scheduler, 0, 1000, [](int i) {
+            if (i == 500)
+            {
+                throw std::runtime_error("parallel");
+            }
+        }, 1);
+    }
+    catch (std::runtime_error&)
+    {
+        caught = true;
+    }
+    CHECK(caught);
+}
+
+static void RunAll(Scheduler& scheduler)
+{
+    TestFor(scheduler);
+    TestReduceSortInvoke(scheduler);
+    TestException(scheduler);
+}
+
+int main()
+{
+    Log::set_log_level(LERROR);
+    Scheduler scheduler(4);
+    scheduler.start();
+    // 构造调度器的线程不在调度器的协程中，阻塞在信号量上等待
+    CHECK(!Fiber::InSchedulerFiber());
+    RunAll(scheduler);
+    // 工作线程的协程中调用时挂起协程等待
+    std::atomic<bool> done{false};
+    scheduler.schedule([&scheduler, &done]() {
+        CHECK(Fiber::InSchedulerFiber());
+        RunAll(scheduler);
+        done = true;
+    });
+    while (!done.load())
+    {
+        usleep(1000);
+    }
+    scheduler.stop();
+    ::printf("test_parallel passed\n");
+    return 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * 共享栈协程测试：调度器把绑定后的协程固定在首次运行的线程上，线程退出后协程仍然可以安全释放
+*/
+#include "exception.h"
+#include "fiber.h"
+#include "log.h"
+#include "scheduler.h"
+#include "test.h"
+#include <atomic>
+#include <unistd.h>
+#include <vector>
+
+// 工作窃取模式下反复让出执行权，每次都在同一个线程上恢复；指定其他线程时抛出 Exception
+static void TestPinned()
+{
+    Config::Lookup<bool>("scheduler.work_stealing", false)->setValue(true);
+    Scheduler scheduler(4, false, "shared");
+    scheduler.start();
+    // 等待所有工作线程开始调度，协程才有可以被窃取、可以被指定的其他线程
+    while (scheduler.getMetrics().threads < 4)
+    {
+        usleep(1000);
+    }
+    static constexpr int kFibers = 16;
+    static constexpr int kYields = 100;
+    std::atomic<int> done{0};
+    std::atomic<int> migrated{0};
+    std::atomic<int> rejected{0};
+    std::vector<Fiber::ptr> fibers;
+    for (int i = 0; i < kFibers; ++i)
+    {
+        fibers.push_back(std::make_shared<Fiber>(
+            [&scheduler, &done, &migrated, &rejected]() {
+                const long thread_id = Log::GetThreadId();
+                for (int j = 0; j < kYields; ++j)
+                {
+                    scheduler.schedule(Fiber::GetThis());
+                    Fiber::YieldToHold();
+                    migrated += (Log::GetThreadId() != thread_id);
+                }
+                for (auto& worker : scheduler.getMetrics().workers)
+                {
+                    if (worker.thread_id != -1 && worker.thread_id != thread_id)
+                    {
+                        try
+                        {
+                            scheduler.schedule(Fiber::GetThis(), worker.thread_id);
+                        }
+                        catch (Exception&)
+                        {
+                            ++rejected;
+                        }
+                        break;
+                    }
+                }
+                ++done;
+            },
+            0, true));
+        scheduler.schedule(fibers.back());
+    }
+    while (done.load() < kFibers)
+    {
+        usleep(1000);
+    }
+    scheduler.stop();
+    CHECK(migrated.load() == 0);
+    CHECK(rejected.load() == kFibers);
+}
+
+// 多个协程绑定同一个线程的共享栈，线程退出之后再释放这些协程
+static void TestOutliveThread()
+{
+    std::vector<Fiber::ptr> fibers;
+    {
+        Scheduler scheduler(1, false, "shared_exit");
+        scheduler.start();
+        std::atomic<int> done{0};
+        for (int i = 0; i < 4; ++i)
+        {
+            fibers.push_back(std::make_shared<Fiber>([&done]() { ++done; }, 0, true));
+            scheduler.schedule(fibers.back());
+        }
+        while (done.load() < 4)
+        {
+            usleep(1000);
+        }
+        scheduler.stop();
+    }
+    for (auto& fiber : fibers)
+    {
+        CHECK(fiber->finish());
+    }
+    fibers.clear();
+}
+
+int main()
+{
+    Log::set_log_level(LERROR);
+    TestPinned();
+    TestOutliveThread();
+    ::printf("test_shared_stack passed\n");
+    return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * 定时器管理器测试：std::set 与分层时间轮两种实现的加入、取消、重置、刷新、周期与条件定时器
+*/
+#include "log.h"
+#include "test.h"
+#include "timer.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+// 每毫秒取出一次到期的定时器并执行回调，持续 ms 毫秒
+static void RunFor(TimerManager& manager, uint64_t ms)
+{
+    const uint64_t end = Log::GetCurrentMS() + ms;
+    std::vector<std::function<void()>> fns;
+    while (Log::GetCurrentMS() < end)
+    {
+        fns.clear();
+        manager.listExpiredCallback(fns);
+        for (auto& fn : fns)
+        {
+            fn();
+        }
+        usleep(1000);
+    }
+}
+
+// 取消的定时器不再执行，重复取消返回 false；超过第一层范围的定时器经过级联后按时到期
+static void TestCancel()
+{
+    static constexpr int kTimers = 60;
+    TimerManager manager;
+    std::vector<int> fired(kTimers, 0);
+    std::vector<Timer::ptr> timers;
+    for (int i = 0; i < kTimers; ++i)
+    {
+        timers.push_back(manager.addTimer(5 + i * 5, [&fired, i]() { ++fired[i]; }));
+    }
+    CHECK(manager.timerCount() == kTimers);
+    for (int i = 1; i < kTimers; i += 2)
+    {
+        CHECK(timers[i]->cancel());
+        CHECK(!timers[i]->cancel());
+    }
+    CHECK(manager.timerCount() == kTimers / 2);
+    RunFor(manager, 5 + kTimers * 5 + 50);
+    for (int i = 0; i < kTimers; ++i)
+    {
+        CHECK(fired[i] == (i % 2 == 0 ? 1 : 0));
+    }
+    CHECK(!manager.hasTimer());
+    // 已经到期的定时器不能再取消或者重置
+    CHECK(!timers[0]->cancel());
+    CHECK(!timers[0]->reset(10, true));
+}
+
+// 重置为更早或者更晚的到期时间，刷新推迟到期时间
+static void TestResetRefresh()
+{
+    TimerManager manager;
+    std::atomic<int> early{0};
+    std::atomic<int> late{0};
+    std::atomic<int> refreshed{0};
+    Timer::ptr early_timer = manager.addTimer(10000, [&early]() { ++early; });
+    Timer::ptr late_timer = manager.addTimer(20, [&late]() { ++late; });
+    Timer::ptr refresh_timer = manager.addTimer(50, [&refreshed]() { ++refreshed; });
+    // 从现在开始 20 毫秒后到期
+    CHECK(early_timer->reset(20, true));
+    // 从加入时开始 300 毫秒后到期，超过时间轮第一层的范围
+    CHECK(late_timer->reset(300, false));
+    for (int i = 0; i < 15; ++i)
+    {
+        RunFor(manager, 10);
+        CHECK(refresh_timer->refresh());
+    }
+    CHECK(early.load() == 1);
+    CHECK(late.load() == 0);
+    CHECK(refreshed.load() == 0);
+    RunFor(manager, 250);
+    CHECK(late.load() == 1);
+    CHECK(refreshed.load() == 1);
+    CHECK(!manager.hasTimer());
+
+    Timer::ptr cancelled = manager.addTimer(10, []() {});
+    CHECK(cancelled->cancel());
+    CHECK(!cancelled->reset(10, true));
+    CHECK(!cancelled->refresh());
+}
+
+// 周期定时器在取消之前重复执行；条件失效的条件定时器不执行回调
+static void TestCyclicCondition()
+{
+    TimerManager manager;
+    std::atomic<int> ticks{0};
+    Timer::ptr cyclic = manager.addTimer(10, [&ticks]() { ++ticks; }, true);
+    std::atomic<int> conditional{0};
+    auto alive = std::make_shared<int>(0);
+    auto dead = std::make_shared<int>(0);
+    manager.addConditionTimer(20, [&conditional]() { ++conditional; }, alive);
+    manager.addConditionTimer(20, [&conditional]() { conditional += 100; }, dead);
+    dead.reset();
+    RunFor(manager, 120);
+    CHECK(ticks.load() >= 5);
+    CHECK(conditional.load() == 1);
+    CHECK(cyclic->cancel());
+    const int stopped = ticks.load();
+    RunFor(manager, 40);
+    CHECK(ticks.load() == stopped);
+    CHECK(!manager.hasTimer());
+}
+
+// 远期定时器：下一次等待时间不晚于到期时间，取消后管理器为空
+static void TestFarTimer()
+{
+    TimerManager manager;
+    Timer::ptr timer = manager.addTimer(20000, []() {});
+    const uint64_t next = manager.getNextTimer();
+    CHECK(next > 0 && next <= 20000);
+    CHECK(timer->cancel());
+    CHECK(!manager.hasTimer());
+    CHECK(manager.getNextTimer() == ~0ull);
+}
+
+int main()
+{
+    Log::set_log_level(LERROR);
+    const bool backends[] = {false, true};
+    for (bool use_wheel : backends)
+    {
+        TimerInfo::g_use_wheel->setValue(use_wheel);
+        TestCancel();
+        TestResetRefresh();
+        TestCyclicCondition();
+        TestFarTimer();
+    }
+    ::printf("test_timer passed\n");
+    return 0;
+}